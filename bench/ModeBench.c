@@ -0,0 +1,1072 @@
+
+/****************************************************************************************
+ *   FileName    : ModeBench.c
+ *   Description : Mode Manager Trace Replay Benchmark C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "TCLog.h"
+#include "ModeXMLParser.h"
+#include "ModeManager.h"
+#include "ModeStats.h"
+#include "ModeStatePage.h"
+
+#define BENCH_LINE_MAX			256
+#define BENCH_SIGNALS_PER_EVENT	4
+#define BENCH_SIGNAL_SLACK		64
+#define BENCH_RELEASE_MAX		256		/* release_resource signals pending between two events */
+
+typedef enum{
+	BenchChangeMode,
+	BenchEndMode,
+	BenchReleaseResourceDone,
+	BenchSuspend,
+	BenchResume,
+	BenchReloadPolicy,
+	TotalBenchEvent
+}BenchEventType;
+
+typedef struct
+{
+	int32_t type;				/* BenchEventType */
+	char mode[128];
+	int32_t app;
+	int32_t resources;
+} BenchEvent;
+
+typedef enum{
+	BenchSignalChangedMode,
+	BenchSignalReleaseResource,
+	BenchSignalEndedMode,
+	BenchSignalSuspendMode,
+	BenchSignalResumeMode,
+	BenchSignalResult			/* change_mode return value, from the replaying thread */
+}BenchSignalType;
+
+typedef struct
+{
+	int32_t type;				/* BenchSignalType */
+	int32_t app;
+	int32_t arg;
+	char mode[64];				/* copied, the manager may pass a request buffer */
+} BenchSignal;
+
+static const char *s_eventNames[TotalBenchEvent] = {
+	"change_mode",
+	"end_mode",
+	"release_resource_done",
+	"suspend",
+	"resume",
+	"reload_policy"
+};
+
+/* policy source, also used by reload_policy */
+static const char *s_policyPath = "defaultmode.xml";
+static const char *s_cachePath = NULL;
+static const char *s_policyDir = NULL;
+static int32_t s_domParser = 0;
+
+static BenchEvent *s_events = NULL;
+static uint32_t s_eventCount = 0;
+
+/* signals of the first pass, appended from the manager thread and the replaying thread */
+static BenchSignal *s_signals = NULL;
+static uint32_t s_signalMax = 0;
+static uint32_t s_signalCount = 0;
+static int32_t s_recording = 0;
+
+/*
+ * change_mode being timed to the changed_mode that grants it, begin is 0 when none. Matching
+ * the mode too leaves out the signals of end_mode requests still queued ahead of it.
+ */
+static uint64_t s_changeBegin = 0;
+static const char *s_changeMode = NULL;
+static int32_t s_changeApp = -1;
+static uint64_t s_changeSignal = 0;
+
+/*
+ * --count-allocs : malloc, calloc and realloc of every thread, the manager's operator new
+ * included, are counted on the way to glibc. The count of an event is what was allocated
+ * while it was called, exact with --inline-arbitration ; threaded, a request queued without
+ * waiting is counted against the events that overlap it.
+ */
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+#endif
+static int32_t s_allocCounting = 0;
+static uint64_t s_allocs = 0;
+
+/* release_resource signals not answered yet, --auto-release answers them between events */
+static ReleaseApp s_releases[BENCH_RELEASE_MAX];
+static uint32_t s_releaseCount = 0;
+static uint64_t s_releaseDropped = 0;
+static int32_t s_autoRelease = 0;
+static pthread_mutex_t s_releaseMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* --state-page, a client thread reads the page for as long as the replay runs */
+static int32_t s_stateReading = 0;
+static uint64_t s_stateReads = 0;
+static uint64_t s_stateFailed = 0;
+static uint64_t s_stateBackwards = 0;
+static uint64_t s_stateTime = 0;
+
+static int32_t LoadTrace(const char *path);
+static int32_t LoadPolicy(void);
+static void RecordSignal(int32_t type, const char *mode, int32_t app, int32_t arg);
+static void BenchChangedMode(const char *mode, int32_t app);
+static void BenchReleaseResource(int32_t resources, int32_t app);
+static void BenchEndedMode(const char *mode, int32_t app);
+static void BenchSuspendMode(void);
+static void BenchResumeMode(void);
+static void BenchTransition(const ModeSignal *signals, int32_t count);
+static int32_t FormatSignal(const BenchSignal *signal, char *buffer, size_t size);
+static int32_t WriteGolden(const char *path);
+static int32_t CompareGolden(const char *path);
+static uint32_t AnswerReleases(void);
+static void *StateReader(void *arg);
+static uint64_t BenchNow(void);
+static uint64_t BenchHeapInUse(void);
+static uint64_t BenchAllocs(void);
+static int32_t CompareLatency(const void *a, const void *b);
+static void ReportLatency(const char *name, uint64_t *samples, uint32_t count);
+static uint64_t Percentile(const uint64_t *samples, uint32_t count, uint32_t percent);
+static void usage(void);
+
+int32_t main(int32_t argc, char *argv[])
+{
+	int32_t ret = 0;
+	int32_t index;
+	const char *tracePath = NULL;
+	const char *goldenPath = NULL;
+	const char *writeGoldenPath = NULL;
+	const char *statePath = NULL;
+	const ModeStatePage *statePage = NULL;
+	pthread_t stateThread;
+	int32_t repeat = 1;
+	int32_t inlineArbitration = 0;
+	int32_t decisionCache = MODE_DECISION_OFF;
+	int32_t signalBatch = MODE_SIGNAL_DIRECT;
+	int32_t summaryLine = 0;
+	uint64_t *latency[TotalBenchEvent];
+	uint32_t latencyCount[TotalBenchEvent];
+	uint64_t *toSignal = NULL;
+	uint32_t toSignalCount = 0;
+	uint64_t allocCount[TotalBenchEvent];
+	uint64_t replayAllocs = 0;
+	uint64_t parseTime = 0;
+	uint64_t parseHeap = 0;
+	long parseRss = 0;
+	uint64_t replayTime = 0;
+
+	TCLogInitialize("MODEBENCH", NULL, 0);
+	TCLogSetLevel(TCLogLevelError);
+
+	for(index = 1; index < argc; index++)
+	{
+		if((strncmp(argv[index], "--policy-cache", 14) == 0) && (index + 1 < argc))
+		{
+			s_cachePath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--policy-dir", 12) == 0) && (index + 1 < argc))
+		{
+			s_policyDir = argv[++index];
+		}
+		else if((strncmp(argv[index], "--policy", 8) == 0) && (index + 1 < argc))
+		{
+			s_policyPath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--trace", 7) == 0) && (index + 1 < argc))
+		{
+			tracePath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--golden", 8) == 0) && (index + 1 < argc))
+		{
+			goldenPath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--write-golden", 14) == 0) && (index + 1 < argc))
+		{
+			writeGoldenPath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--state-page", 12) == 0) && (index + 1 < argc))
+		{
+			statePath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--repeat", 8) == 0) && (index + 1 < argc))
+		{
+			repeat = atoi(argv[++index]);
+		}
+		else if(strncmp(argv[index], "--inline-arbitration", 20) == 0)
+		{
+			inlineArbitration = 1;
+		}
+		else if(strncmp(argv[index], "--decision-cache", 16) == 0)
+		{
+			decisionCache = MODE_DECISION_CACHE;
+		}
+		else if(strncmp(argv[index], "--verify-decision-cache", 23) == 0)
+		{
+			decisionCache = MODE_DECISION_VERIFY;
+		}
+		else if((strncmp(argv[index], "--signal-batch", 14) == 0) && (index + 1 < argc))
+		{
+			index++;
+			if(strcmp(argv[index], "direct") == 0)
+			{
+				signalBatch = MODE_SIGNAL_DIRECT;
+			}
+			else if(strcmp(argv[index], "batch") == 0)
+			{
+				signalBatch = MODE_SIGNAL_BATCH;
+			}
+			else if(strcmp(argv[index], "transition") == 0)
+			{
+				signalBatch = MODE_SIGNAL_TRANSITION;
+			}
+			else
+			{
+				usage();
+				ret = -1;
+			}
+		}
+		else if(strncmp(argv[index], "--dom-parser", 12) == 0)
+		{
+			s_domParser = 1;
+		}
+		else if(strncmp(argv[index], "--auto-release", 14) == 0)
+		{
+			s_autoRelease = 1;
+		}
+		else if(strncmp(argv[index], "--count-allocs", 14) == 0)
+		{
+#if defined(__GLIBC__)
+			s_allocCounting = 1;
+#else
+			(void)fprintf(stderr, "--count-allocs needs glibc\n");
+			ret = -1;
+#endif
+		}
+		else if(strncmp(argv[index], "--summary", 9) == 0)
+		{
+			summaryLine = 1;
+		}
+		else if(strncmp(argv[index], "--debug", 7) == 0)
+		{
+			TCLogSetLevel(TCLogLevelDebug);
+		}
+		else
+		{
+			usage();
+			ret = -1;
+		}
+	}
+	if((ret == 0) && ((tracePath == NULL) || (repeat < 1)))
+	{
+		usage();
+		ret = -1;
+	}
+
+	if(ret == 0)
+	{
+		ret = LoadTrace(tracePath);
+	}
+	if(ret == 0)
+	{
+		uint64_t heap = BenchHeapInUse();
+		uint64_t start = BenchNow();
+		struct rusage usage;
+		ret = LoadPolicy();
+		parseTime = BenchNow() - start;
+		(void)getrusage(RUSAGE_SELF, &usage);
+		parseRss = usage.ru_maxrss;
+		/* what the parsed policy keeps, the DOM is freed by then */
+		parseHeap = BenchHeapInUse();
+		parseHeap = (parseHeap > heap) ? (parseHeap - heap) : 0U;
+	}
+	for(index = 0; index < (int32_t)TotalBenchEvent; index++)
+	{
+		latency[index] = NULL;
+		latencyCount[index] = 0;
+		allocCount[index] = 0;
+	}
+	if(ret == 0)
+	{
+		s_signalMax = (s_eventCount * BENCH_SIGNALS_PER_EVENT) + BENCH_SIGNAL_SLACK;
+		s_signals = (BenchSignal *)calloc(s_signalMax, sizeof(BenchSignal));
+		toSignal = (uint64_t *)calloc((size_t)s_eventCount * (size_t)repeat + 1U, sizeof(uint64_t));
+		for(index = 0; index < (int32_t)TotalBenchEvent; index++)
+		{
+			latency[index] = (uint64_t *)calloc((size_t)s_eventCount * (size_t)repeat + 1U, sizeof(uint64_t));
+			if(latency[index] == NULL)
+			{
+				ret = -1;
+			}
+		}
+		if((s_signals == NULL) || (toSignal == NULL))
+		{
+			ret = -1;
+		}
+		if(ret != 0)
+		{
+			(void)fprintf(stderr, "out of memory\n");
+		}
+	}
+
+	if(ret == 0)
+	{
+		ModeManagerSignalCB cb;
+		int32_t pass;
+		uint32_t event;
+		uint64_t start;
+
+		cb._ChangedMode = BenchChangedMode;
+		cb._ReleaseResource = BenchReleaseResource;
+		cb._EndedMode = BenchEndedMode;
+		cb._SuspendMode = BenchSuspendMode;
+		cb._ResumeMode = BenchResumeMode;
+		cb._Transition = BenchTransition;
+		setModeManagerSignalCB(&cb);
+		setModePolicyLoadCB(LoadPolicy);
+		setModeManagerInlineArbitration(inlineArbitration);
+		setModeManagerDecisionCache(decisionCache);
+		setModeManagerSignalBatch(signalBatch);
+		if(statePath != NULL)
+		{
+			if(ModeStatePageOpen(statePath) == 0)
+			{
+				statePage = ModeStatePageAttach(statePath);
+			}
+			if(statePage == NULL)
+			{
+				(void)fprintf(stderr, "can not publish the state page %s\n", statePath);
+				ret = -1;
+			}
+		}
+		(void)ModeManagerInitiallize();
+		if(statePage != NULL)
+		{
+			__atomic_store_n(&s_stateReading, 1, __ATOMIC_RELAXED);
+			if(pthread_create(&stateThread, NULL, StateReader, (void *)statePage) != 0)
+			{
+				statePage = NULL;
+			}
+		}
+
+		start = BenchNow();
+		replayAllocs = BenchAllocs();
+		for(pass = 0; pass < repeat; pass++)
+		{
+			__atomic_store_n(&s_recording, (pass == 0) ? 1 : 0, __ATOMIC_RELAXED);
+			for(event = 0; event < s_eventCount; event++)
+			{
+				const BenchEvent *item = &s_events[event];
+				uint64_t allocs = BenchAllocs();
+				uint64_t begin = BenchNow();
+				if(item->type == (int32_t)BenchChangeMode)
+				{
+					int32_t result;
+					uint64_t signal;
+					__atomic_store_n(&s_changeSignal, 0U, __ATOMIC_RELAXED);
+					__atomic_store_n(&s_changeMode, item->mode, __ATOMIC_RELAXED);
+					__atomic_store_n(&s_changeApp, item->app, __ATOMIC_RELAXED);
+					__atomic_store_n(&s_changeBegin, begin, __ATOMIC_RELEASE);
+					result = cmpModePriority(item->mode, item->app);
+					latency[item->type][latencyCount[item->type]++] = BenchNow() - begin;
+					/* the signals of a request are flushed before it is answered */
+					__atomic_store_n(&s_changeBegin, 0U, __ATOMIC_RELAXED);
+					signal = __atomic_load_n(&s_changeSignal, __ATOMIC_ACQUIRE);
+					if(signal >= begin)
+					{
+						toSignal[toSignalCount++] = signal - begin;
+					}
+					RecordSignal(BenchSignalResult, item->mode, item->app, result);
+				}
+				else
+				{
+					if(item->type == (int32_t)BenchEndMode)
+					{
+						resumeMode(item->mode, item->app);
+					}
+					else if(item->type == (int32_t)BenchReleaseResourceDone)
+					{
+						sendModeChanged(item->resources, item->app);
+					}
+					else if(item->type == (int32_t)BenchSuspend)
+					{
+						systemSuspendMode();
+					}
+					else if(item->type == (int32_t)BenchResume)
+					{
+						systemResumeMode();
+					}
+					else
+					{
+						(void)reloadModePolicy();
+					}
+					latency[item->type][latencyCount[item->type]++] = BenchNow() - begin;
+				}
+				allocCount[item->type] += BenchAllocs() - allocs;
+				if(s_autoRelease != 0)
+				{
+					(void)AnswerReleases();
+				}
+			}
+			/* change_mode is answered in queue order, an unknown mode waits out everything before it */
+			do
+			{
+				(void)cmpModePriority("", -1);
+			} while((s_autoRelease != 0) && (AnswerReleases() != 0U));
+			__atomic_store_n(&s_recording, 0, __ATOMIC_RELAXED);
+		}
+		replayTime = BenchNow() - start;
+		replayAllocs = BenchAllocs() - replayAllocs;
+		if(statePage != NULL)
+		{
+			__atomic_store_n(&s_stateReading, 0, __ATOMIC_RELAXED);
+			(void)pthread_join(stateThread, NULL);
+		}
+		ModeManagerRelease();
+		if(statePage != NULL)
+		{
+			ModeStatePage copy;
+			if(ModeStatePageRead(statePage, &copy) == 0)
+			{
+				(void)printf("state page : generation %llu, %llu reads at %.1f nsec, %llu failed, %llu went backwards\n",
+							 (unsigned long long)copy.generation, (unsigned long long)s_stateReads,
+							 (s_stateReads > 0U) ? ((double)s_stateTime / (double)s_stateReads) : 0.0,
+							 (unsigned long long)s_stateFailed, (unsigned long long)s_stateBackwards);
+			}
+			if((s_stateFailed != 0U) || (s_stateBackwards != 0U))
+			{
+				ret = -1;
+			}
+			ModeStatePageDetach(statePage);
+		}
+		ModeStatePageClose();
+	}
+
+	if(ret == 0)
+	{
+		uint64_t events = (uint64_t)s_eventCount * (uint64_t)repeat;
+		int32_t method;
+		int32_t stage;
+		ModeStatsSummary summary;
+		ModeManagerStats stats;
+
+		(void)printf("policy %s parsed in %.3f msec (%s), %llu KiB heap kept, peak RSS %ld KiB\n", s_policyPath,
+					 (double)parseTime / 1000000.0,
+					 (s_domParser != 0) ? "DOM" : ((s_cachePath != NULL) ? "cache" : ((s_policyDir != NULL) ? "overlays" : "stream")),
+					 (unsigned long long)(parseHeap / 1024U), parseRss);
+		(void)printf("%llu events in %.3f msec, %.0f events/sec (%s arbitration)\n",
+					 (unsigned long long)events, (double)replayTime / 1000000.0,
+					 (replayTime > 0U) ? ((double)events * 1000000000.0 / (double)replayTime) : 0.0,
+					 inlineArbitration ? "inline" : "threaded");
+		(void)printf("%-22s %10s %10s %10s %10s %10s (nsec, as seen by the caller)\n",
+					 "event", "count", "p50", "p90", "p99", "max");
+		for(index = 0; index < (int32_t)TotalBenchEvent; index++)
+		{
+			ReportLatency(s_eventNames[index], latency[index], latencyCount[index]);
+		}
+		ReportLatency("change->changed_mode", toSignal, toSignalCount);
+		if(s_releaseDropped != 0U)
+		{
+			(void)printf("%llu release_resource signals were not answered, raise BENCH_RELEASE_MAX\n",
+						 (unsigned long long)s_releaseDropped);
+		}
+		if(s_allocCounting != 0)
+		{
+			(void)printf("%-22s %10s %10s %10s (heap allocations while called)\n", "event", "count", "allocs", "per call");
+			for(index = 0; index < (int32_t)TotalBenchEvent; index++)
+			{
+				if(latencyCount[index] > 0U)
+				{
+					(void)printf("%-22s %10u %10llu %10.3f\n", s_eventNames[index], latencyCount[index],
+								 (unsigned long long)allocCount[index],
+								 (double)allocCount[index] / (double)latencyCount[index]);
+				}
+			}
+			(void)printf("%-22s %10llu %10llu %10.3f\n", "replay", (unsigned long long)events,
+						 (unsigned long long)replayAllocs, (double)replayAllocs / (double)events);
+		}
+		(void)printf("%-22s %-9s %10s %10s %10s %10s %10s (nsec, inside the manager)\n",
+					 "method", "stage", "count", "p50", "p90", "p99", "max");
+		for(method = 0; method < (int32_t)TotalModeStatsMethod; method++)
+		{
+			for(stage = 0; stage < (int32_t)TotalModeStatsStage; stage++)
+			{
+				ModeStatsSummarize(method, stage, &summary);
+				if((summary.count != 0U) && (stage != (int32_t)ModeStatsDispatch))
+				{
+					(void)printf("%-22s %-9s %10llu %10llu %10llu %10llu %10llu\n",
+								 g_modeStatsMethodNames[method], g_modeStatsStageNames[stage],
+								 (unsigned long long)summary.count, (unsigned long long)summary.p50,
+								 (unsigned long long)summary.p90, (unsigned long long)summary.p99,
+								 (unsigned long long)summary.max);
+				}
+			}
+		}
+		getModeManagerStats(&stats);
+		if(decisionCache == MODE_DECISION_OFF)
+		{
+			(void)printf("decision cache : off\n");
+		}
+		else
+		{
+			(void)printf("decision cache : %llu hits, %llu misses, %llu mismatches, %u states\n",
+						 (unsigned long long)stats.decisionHits, (unsigned long long)stats.decisionMisses,
+						 (unsigned long long)stats.decisionMismatches, stats.decisionStates);
+		}
+		if(stats.decisionMismatches != 0U)
+		{
+			ret = -1;
+		}
+		(void)printf("signals : %llu sent, %llu coalesced\n",
+					 (unsigned long long)stats.signalsSent, (unsigned long long)stats.signalsCoalesced);
+		if(summaryLine != 0)
+		{
+			struct rusage usage;
+			ModeStatsSummary run;
+			uint64_t *change = latency[BenchChangeMode];
+			uint32_t changeCount = latencyCount[BenchChangeMode];
+			(void)getrusage(RUSAGE_SELF, &usage);
+			ModeStatsSummarize(ModeStatsChangeMode, ModeStatsRun, &run);
+			/* the caller side samples are sorted by ReportLatency */
+			(void)printf("summary parse_usec=%llu heap_kib=%llu parse_maxrss_kib=%ld maxrss_kib=%ld events_per_sec=%.0f "
+						 "change_p50=%llu change_p99=%llu change_max=%llu run_p50=%llu run_p99=%llu\n",
+						 (unsigned long long)(parseTime / 1000U), (unsigned long long)(parseHeap / 1024U),
+						 parseRss, usage.ru_maxrss,
+						 (replayTime > 0U) ? ((double)events * 1000000000.0 / (double)replayTime) : 0.0,
+						 (unsigned long long)Percentile(change, changeCount, 50U),
+						 (unsigned long long)Percentile(change, changeCount, 99U),
+						 (unsigned long long)Percentile(change, changeCount, 100U),
+						 (unsigned long long)run.p50, (unsigned long long)run.p99);
+		}
+	}
+
+	if((ret == 0) && (writeGoldenPath != NULL))
+	{
+		ret = WriteGolden(writeGoldenPath);
+	}
+	if((ret == 0) && (goldenPath != NULL))
+	{
+		ret = CompareGolden(goldenPath);
+	}
+
+	for(index = 0; index < (int32_t)TotalBenchEvent; index++)
+	{
+		free(latency[index]);
+	}
+	free(toSignal);
+	free(s_signals);
+	free(s_events);
+	return (ret == 0) ? 0 : 1;
+}
+
+/*
+ * trace : one event per line, '#' starts a comment
+ *   change_mode MODE APP
+ *   end_mode MODE APP
+ *   release_resource_done RESOURCES APP
+ *   suspend
+ *   resume
+ *   reload_policy
+ */
+static int32_t LoadTrace(const char *path)
+{
+	int32_t ret = 0;
+	FILE *fp = fopen(path, "r");
+	uint32_t size = 0;
+	uint32_t lineNumber = 0;
+	char line[BENCH_LINE_MAX];
+
+	if(fp == NULL)
+	{
+		(void)fprintf(stderr, "can not open trace %s\n", path);
+		ret = -1;
+	}
+	while((ret == 0) && (fgets(line, (int32_t)sizeof(line), fp) != NULL))
+	{
+		char name[BENCH_LINE_MAX];
+		char first[BENCH_LINE_MAX];
+		int32_t app = 0;
+		int32_t fields;
+		int32_t type;
+		BenchEvent event;
+		lineNumber++;
+
+		line[strcspn(line, "#")] = '\0';
+		fields = sscanf(line, "%255s %255s %d", name, first, &app);
+		(void)memset(&event, 0, sizeof(event));
+		event.type = -1;
+		for(type = 0; type < (int32_t)TotalBenchEvent; type++)
+		{
+			if((fields > 0) && (strcmp(name, s_eventNames[type]) == 0))
+			{
+				event.type = type;
+			}
+		}
+		if(fields <= 0)
+		{
+			/* blank or comment line */
+		}
+		else if(((event.type == (int32_t)BenchChangeMode) || (event.type == (int32_t)BenchEndMode)) && (fields == 3) &&
+				(strlen(first) < sizeof(event.mode)))
+		{
+			(void)memcpy(event.mode, first, strlen(first) + 1U);
+			event.app = app;
+		}
+		else if((event.type == (int32_t)BenchReleaseResourceDone) && (fields == 3))
+		{
+			event.resources = atoi(first);
+			event.app = app;
+		}
+		else if(((event.type == (int32_t)BenchSuspend) || (event.type == (int32_t)BenchResume) ||
+				 (event.type == (int32_t)BenchReloadPolicy)) && (fields == 1))
+		{
+			event.app = -1;
+		}
+		else
+		{
+			(void)fprintf(stderr, "%s:%u: can not parse '%s'\n", path, lineNumber, name);
+			ret = -1;
+		}
+
+		if((ret == 0) && (fields > 0) && (s_eventCount == size))
+		{
+			BenchEvent *events;
+			size = (size == 0U) ? 256U : (size * 2U);
+			events = (BenchEvent *)realloc(s_events, size * sizeof(BenchEvent));
+			if(events != NULL)
+			{
+				s_events = events;
+			}
+			else
+			{
+				(void)fprintf(stderr, "out of memory\n");
+				ret = -1;
+			}
+		}
+		if((ret == 0) && (fields > 0))
+		{
+			s_events[s_eventCount++] = event;
+		}
+	}
+	if(fp != NULL)
+	{
+		(void)fclose(fp);
+	}
+	if((ret == 0) && (s_eventCount == 0U))
+	{
+		(void)fprintf(stderr, "trace %s is empty\n", path);
+		ret = -1;
+	}
+	return ret;
+}
+
+static int32_t LoadPolicy(void)
+{
+	int32_t ret;
+	if(s_domParser != 0)
+	{
+		ret = parseDocDOM(s_policyPath);
+	}
+	else if((s_cachePath != NULL) || (s_policyDir != NULL))
+	{
+		ret = parseDocSet(s_policyPath, s_policyDir, s_cachePath);
+	}
+	else
+	{
+		ret = parseDoc(s_policyPath);
+	}
+	return ret;
+}
+
+static void RecordSignal(int32_t type, const char *mode, int32_t app, int32_t arg)
+{
+	if(__atomic_load_n(&s_recording, __ATOMIC_RELAXED) != 0)
+	{
+		uint32_t slot = __atomic_fetch_add(&s_signalCount, 1U, __ATOMIC_RELAXED);
+		if(slot < s_signalMax)
+		{
+			s_signals[slot].type = type;
+			s_signals[slot].mode[0] = '\0';
+			if(mode != NULL)
+			{
+				(void)strncpy(s_signals[slot].mode, mode, sizeof(s_signals[slot].mode) - 1U);
+				s_signals[slot].mode[sizeof(s_signals[slot].mode) - 1U] = '\0';
+			}
+			s_signals[slot].app = app;
+			s_signals[slot].arg = arg;
+		}
+	}
+}
+
+static void BenchChangedMode(const char *mode, int32_t app)
+{
+	RecordSignal(BenchSignalChangedMode, mode, app, 0);
+	if((__atomic_load_n(&s_changeBegin, __ATOMIC_ACQUIRE) != 0U) && (app == __atomic_load_n(&s_changeApp, __ATOMIC_RELAXED)) &&
+	   (strcmp(mode, __atomic_load_n(&s_changeMode, __ATOMIC_RELAXED)) == 0))
+	{
+		uint64_t none = 0;
+		(void)__atomic_compare_exchange_n(&s_changeSignal, &none, BenchNow(), 0,
+										  __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+}
+
+static void BenchReleaseResource(int32_t resources, int32_t app)
+{
+	RecordSignal(BenchSignalReleaseResource, NULL, app, resources);
+	if(s_autoRelease != 0)
+	{
+		/* called on the manager thread or under the inline lock, answered from the replaying thread */
+		pthread_mutex_lock(&s_releaseMutex);
+		if(s_releaseCount < BENCH_RELEASE_MAX)
+		{
+			s_releases[s_releaseCount].app = app;
+			s_releases[s_releaseCount].resource = resources;
+			s_releaseCount++;
+		}
+		else
+		{
+			s_releaseDropped++;
+		}
+		pthread_mutex_unlock(&s_releaseMutex);
+	}
+}
+
+static void BenchEndedMode(const char *mode, int32_t app)
+{
+	RecordSignal(BenchSignalEndedMode, mode, app, 0);
+}
+
+static void BenchSuspendMode(void)
+{
+	RecordSignal(BenchSignalSuspendMode, NULL, -1, 0);
+}
+
+static void BenchResumeMode(void)
+{
+	RecordSignal(BenchSignalResumeMode, NULL, -1, 0);
+}
+
+/* recorded one by one, so the golden is the same whatever --signal-batch */
+static void BenchTransition(const ModeSignal *signals, int32_t count)
+{
+	int32_t index;
+	for(index = 0; index < count; index++)
+	{
+		if(signals[index].event == MODE_SIGNAL_CHANGED_MODE)
+		{
+			BenchChangedMode(signals[index].mode, signals[index].app);
+		}
+		else if(signals[index].event == MODE_SIGNAL_RELEASE_RESOURCE)
+		{
+			BenchReleaseResource(signals[index].resources, signals[index].app);
+		}
+		else if(signals[index].event == MODE_SIGNAL_ENDED_MODE)
+		{
+			BenchEndedMode(signals[index].mode, signals[index].app);
+		}
+		else if(signals[index].event == MODE_SIGNAL_SUSPEND_MODE)
+		{
+			BenchSuspendMode();
+		}
+		else
+		{
+			BenchResumeMode();
+		}
+	}
+}
+
+static int32_t FormatSignal(const BenchSignal *signal, char *buffer, size_t size)
+{
+	int32_t ret;
+	if(signal->type == (int32_t)BenchSignalChangedMode)
+	{
+		ret = snprintf(buffer, size, "changed_mode %s %d", signal->mode, signal->app);
+	}
+	else if(signal->type == (int32_t)BenchSignalReleaseResource)
+	{
+		ret = snprintf(buffer, size, "release_resource %d %d", signal->arg, signal->app);
+	}
+	else if(signal->type == (int32_t)BenchSignalEndedMode)
+	{
+		ret = snprintf(buffer, size, "ended_mode %s %d", signal->mode, signal->app);
+	}
+	else if(signal->type == (int32_t)BenchSignalSuspendMode)
+	{
+		ret = snprintf(buffer, size, "suspend_mode");
+	}
+	else if(signal->type == (int32_t)BenchSignalResumeMode)
+	{
+		ret = snprintf(buffer, size, "resume_mode");
+	}
+	else
+	{
+		ret = snprintf(buffer, size, "change_mode %s %d -> %d", signal->mode, signal->app, signal->arg);
+	}
+	return ret;
+}
+
+static int32_t WriteGolden(const char *path)
+{
+	int32_t ret = 0;
+	FILE *fp = NULL;
+	if(s_signalCount > s_signalMax)
+	{
+		(void)fprintf(stderr, "golden : %u signals do not fit the %u kept\n", s_signalCount, s_signalMax);
+		ret = -1;
+	}
+	else
+	{
+		fp = fopen(path, "w");
+	}
+	if(fp != NULL)
+	{
+		uint32_t index;
+		char line[BENCH_LINE_MAX];
+		for(index = 0; (index < s_signalCount) && (index < s_signalMax); index++)
+		{
+			(void)FormatSignal(&s_signals[index], line, sizeof(line));
+			(void)fprintf(fp, "%s\n", line);
+		}
+		(void)fclose(fp);
+		(void)printf("golden : %u signals written to %s\n", index, path);
+	}
+	else if(ret == 0)
+	{
+		(void)fprintf(stderr, "can not open %s\n", path);
+		ret = -1;
+	}
+	return ret;
+}
+
+static int32_t CompareGolden(const char *path)
+{
+	int32_t ret = 0;
+	FILE *fp = fopen(path, "r");
+	if(fp != NULL)
+	{
+		uint32_t index = 0;
+		uint32_t count = (s_signalCount < s_signalMax) ? s_signalCount : s_signalMax;
+		char expected[BENCH_LINE_MAX];
+		char actual[BENCH_LINE_MAX];
+		while((ret == 0) && (fgets(expected, (int32_t)sizeof(expected), fp) != NULL))
+		{
+			expected[strcspn(expected, "\n")] = '\0';
+			if(index < count)
+			{
+				(void)FormatSignal(&s_signals[index], actual, sizeof(actual));
+			}
+			else
+			{
+				actual[0] = '\0';
+			}
+			if(strcmp(expected, actual) != 0)
+			{
+				(void)printf("golden : signal %u differs, expected '%s' got '%s'\n", index + 1U, expected, actual);
+				ret = -1;
+			}
+			index++;
+		}
+		if((ret == 0) && (s_signalCount > s_signalMax))
+		{
+			(void)printf("golden : %u signals do not fit the %u kept\n", s_signalCount, s_signalMax);
+			ret = -1;
+		}
+		if((ret == 0) && (index != count))
+		{
+			(void)printf("golden : expected %u signals got %u\n", index, count);
+			ret = -1;
+		}
+		if(ret == 0)
+		{
+			(void)printf("golden : %u signals match %s\n", count, path);
+		}
+		(void)fclose(fp);
+	}
+	else
+	{
+		(void)fprintf(stderr, "can not open %s\n", path);
+		ret = -1;
+	}
+	return ret;
+}
+
+static uint32_t AnswerReleases(void)
+{
+	ReleaseApp pending[BENCH_RELEASE_MAX];
+	uint32_t count;
+	uint32_t index;
+	pthread_mutex_lock(&s_releaseMutex);
+	count = s_releaseCount;
+	(void)memcpy(pending, s_releases, count * sizeof(ReleaseApp));
+	s_releaseCount = 0;
+	pthread_mutex_unlock(&s_releaseMutex);
+	for(index = 0; index < count; index++)
+	{
+		sendModeChanged(pending[index].resource, pending[index].app);
+	}
+	return count;
+}
+
+/* what a client does, a consistent copy of the page and the generation never going back */
+static void *StateReader(void *arg)
+{
+	const ModeStatePage *page = (const ModeStatePage *)arg;
+	ModeStatePage copy;
+	uint64_t generation = 0;
+	uint64_t start = BenchNow();
+	while(__atomic_load_n(&s_stateReading, __ATOMIC_RELAXED) != 0)
+	{
+		if(ModeStatePageRead(page, &copy) != 0)
+		{
+			s_stateFailed++;
+		}
+		else
+		{
+			if(copy.generation < generation)
+			{
+				s_stateBackwards++;
+			}
+			generation = copy.generation;
+			s_stateReads++;
+		}
+	}
+	s_stateTime = BenchNow() - start;
+	return NULL;
+}
+
+static uint64_t BenchNow(void)
+{
+	struct timespec now;
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t BenchHeapInUse(void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+#else
+	struct mallinfo info = mallinfo();
+#endif
+	return (uint64_t)info.uordblks + (uint64_t)info.hblkhd;
+}
+
+static uint64_t BenchAllocs(void)
+{
+	return __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+}
+
+#if defined(__GLIBC__)
+void *malloc(size_t size)
+{
+	if(__atomic_load_n(&s_allocCounting, __ATOMIC_RELAXED) != 0)
+	{
+		(void)__atomic_fetch_add(&s_allocs, 1U, __ATOMIC_RELAXED);
+	}
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	if(__atomic_load_n(&s_allocCounting, __ATOMIC_RELAXED) != 0)
+	{
+		(void)__atomic_fetch_add(&s_allocs, 1U, __ATOMIC_RELAXED);
+	}
+	return __libc_calloc(count, size);
+}
+
+/* any realloc to a non-zero size counts as one, moved or not */
+void *realloc(void *ptr, size_t size)
+{
+	if((__atomic_load_n(&s_allocCounting, __ATOMIC_RELAXED) != 0) && (size > 0U))
+	{
+		(void)__atomic_fetch_add(&s_allocs, 1U, __ATOMIC_RELAXED);
+	}
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static int32_t CompareLatency(const void *a, const void *b)
+{
+	uint64_t left = *(const uint64_t *)a;
+	uint64_t right = *(const uint64_t *)b;
+	return (left > right) - (left < right);
+}
+
+static void ReportLatency(const char *name, uint64_t *samples, uint32_t count)
+{
+	if(count > 0U)
+	{
+		qsort(samples, count, sizeof(uint64_t), CompareLatency);
+		(void)printf("%-22s %10u %10llu %10llu %10llu %10llu\n", name, count,
+					 (unsigned long long)Percentile(samples, count, 50U),
+					 (unsigned long long)Percentile(samples, count, 90U),
+					 (unsigned long long)Percentile(samples, count, 99U),
+					 (unsigned long long)Percentile(samples, count, 100U));
+	}
+}
+
+static uint64_t Percentile(const uint64_t *samples, uint32_t count, uint32_t percent)
+{
+	uint64_t ret = 0;
+	if(count > 0U)
+	{
+		uint64_t slot = ((uint64_t)count * percent) / 100U;
+		ret = samples[(slot < count) ? slot : (count - 1U)];
+	}
+	return ret;
+}
+
+static void usage(void)
+{
+	(void)printf("Usage : TCModeManagerBench --trace FILE [OPTIONS]...\n");
+	(void)printf("\t--policy FILE : mode policy (default defaultmode.xml)\n");
+	(void)printf("\t--policy-cache FILE : load the policy from FILE, compiled from the XML if missing or stale\n");
+	(void)printf("\t--policy-dir DIR : lay the *.xml files of DIR over the policy, see parseDocSet()\n");
+	(void)printf("\t--dom-parser : parse the policy with parseDocDOM() instead of the streaming parseDoc()\n");
+	(void)printf("\t--trace FILE : events to replay\n");
+	(void)printf("\t--repeat N : replay the trace N times, signals are checked on the first pass\n");
+	(void)printf("\t--state-page FILE : publish the state page in FILE and read it from a client thread meanwhile\n");
+	(void)printf("\t--golden FILE : fail unless the signals of the first pass match FILE\n");
+	(void)printf("\t--write-golden FILE : write the signals of the first pass to FILE\n");
+	(void)printf("\t--inline-arbitration : arbitrate on the replaying thread\n");
+	(void)printf("\t--decision-cache : answer a stack state seen before from the decision cache\n");
+	(void)printf("\t--verify-decision-cache : walk the stacks for every change_mode and fail on a cached decision that differs\n");
+	(void)printf("\t--signal-batch direct|batch|transition : how the signals of a request are sent (default direct)\n");
+	(void)printf("\t--auto-release : answer every release_resource with release_resource_done\n");
+	(void)printf("\t--count-allocs : count the heap allocations made while each event is called\n");
+	(void)printf("\t--summary : end with a single key=value line for scripts\n");
+	(void)printf("\t--debug : debug log on\n");
+}
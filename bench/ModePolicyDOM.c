@@ -0,0 +1,172 @@
+/****************************************************************************************
+ *   FileName    : ModePolicyDOM.c
+ *   Description : Mode Policy DOM Parser C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+/*
+ * parseDocDOM() loads the whole document before walking it. The daemon parses with the
+ * streaming parseDoc(), this one is linked into TCModeManagerBench only so --dom-parser
+ * can compare the two.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+#include <libxml/parser.h>
+
+#include "TCLog.h"
+#include "ModeXMLParser.h"
+#include "ModeManager.h"
+
+/* the former DOM walk of ModeXMLParser.c, it knows the built-in resources only */
+int32_t parseDocDOM(const char *docname)
+{
+	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
+	int32_t ret = 0;
+	xmlDocPtr doc;
+	xmlNodePtr cur;
+
+	doc = xmlParseFile(docname);
+
+	if(doc == NULL)
+	{
+		TCLog(TCLogLevelError, "[PARSER]Document not parsed successfully. \n");
+		ret = -1;
+	}
+	if(ret != -1)
+	{
+		cur = xmlDocGetRootElement(doc);
+		if(cur == NULL)
+		{
+			TCLog(TCLogLevelError, "[PARSER]empty document\n");
+			ret = -1;
+		}
+	}
+	if(ret != -1)
+	{
+		if(xmlStrcmp((cur->name), (const xmlChar *)"policies") != 0)
+		{
+			TCLog(TCLogLevelError, "[PARSER]document of the wrong type, root node != policies");
+			ret = -1;
+		}
+	}
+	if(ret != -1)
+	{
+		xmlNodePtr first = cur->xmlChildrenNode;
+		Mode configMode;
+		xmlChar *key;
+		/* resources first, like parseDoc() */
+		for(cur = first; cur != NULL; cur = cur->next)
+		{
+			if (xmlStrcmp(cur->name, (const xmlChar *)"resource") == 0)
+			{
+				xmlChar *name = xmlGetProp(cur, (const xmlChar *)"name");
+				key = xmlGetProp(cur, (const xmlChar *)"timeout");
+				if((name != NULL) && (key != NULL))
+				{
+					(void)setModeResource((char*)name, 0, atoi((char*)key));
+				}
+				if(name != NULL)
+				{
+					xmlFree(name);
+				}
+				if(key != NULL)
+				{
+					xmlFree(key);
+				}
+			}
+		}
+		cur = first;
+		while (cur != NULL)
+		{
+			(void)memset(&configMode, 0, sizeof(Mode));
+			if (xmlStrcmp(cur->name, (const xmlChar *)"mode") == 0)
+			{
+				key = xmlGetProp(cur, (const xmlChar *)"name");
+				if(key != NULL)
+				{
+					(void)strncpy(configMode.mode,(char*)key, (uint32_t)xmlStrlen(key));
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"app");
+				if(key != NULL)
+				{
+					configMode.app = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"audio");
+				if(key != NULL)
+				{
+					configMode.audio = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"display");
+				if(key != NULL)
+				{
+					configMode.display = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"tuner");
+				if(key != NULL)
+				{
+					configMode.tuner = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"full");
+				if(key != NULL)
+				{
+					configMode.full = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"resume");
+				if(key != NULL)
+				{
+					configMode.resume = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"mixing");
+				if(key != NULL)
+				{
+					configMode.mixing = atoi((char*)key);
+					xmlFree(key);
+				}
+				key = xmlGetProp(cur, (const xmlChar *)"exclusive");
+				if(key != NULL)
+				{
+					configMode.exclusive = atoi((char*)key);
+					xmlFree(key);
+				}
+				setModePolicy(configMode);
+			}
+			cur = cur->next;
+		}
+	}
+	xmlFreeDoc(doc);
+	if(ret != 0)
+	{
+		TCLog(TCLogLevelError, "[PARSER]Config File Parsing Failed\n");
+	}
+	return ret;
+}
@@ -0,0 +1,352 @@
+
+/****************************************************************************************
+ *   FileName    : ModePolicyGen.c
+ *   Description : Mode Manager Synthetic Policy Generator C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_EVENTS_DEFAULT		10000
+#define GEN_TUNER_APP			5		/* every 5th app plays from the tuner */
+
+typedef struct
+{
+	int32_t level;				/* audio and display priority, 1..3 */
+	int32_t tuner;
+	int32_t full;
+	int32_t resume;
+	int32_t mixing;
+	int32_t exclusive;			/* -1 leaves the attribute out */
+	int32_t background;			/* a "<mode>bg" row follows */
+} GenMode;
+
+static GenMode *s_modes = NULL;		/* s_apps x s_modeCount, app major */
+static int32_t s_apps = 0;
+static int32_t s_modeCount = 0;
+static uint32_t s_seed = 1;
+
+static uint32_t GenRandom(void);
+static uint32_t GenPick(uint32_t range);
+static void GenerateModes(void);
+static uint32_t WritePolicy(FILE *fp);
+static uint32_t WriteTrace(FILE *fp, uint32_t events);
+static void WriteChange(FILE *fp, int32_t *active, int32_t app);
+static void usage(void);
+
+int32_t main(int32_t argc, char *argv[])
+{
+	int32_t ret = 0;
+	int32_t index;
+	const char *policyPath = NULL;
+	const char *tracePath = NULL;
+	int32_t events = GEN_EVENTS_DEFAULT;
+
+	s_apps = 8;
+	s_modeCount = 4;
+	for(index = 1; index < argc; index++)
+	{
+		if((strncmp(argv[index], "--apps", 6) == 0) && (index + 1 < argc))
+		{
+			s_apps = atoi(argv[++index]);
+		}
+		else if((strncmp(argv[index], "--modes", 7) == 0) && (index + 1 < argc))
+		{
+			s_modeCount = atoi(argv[++index]);
+		}
+		else if((strncmp(argv[index], "--events", 8) == 0) && (index + 1 < argc))
+		{
+			events = atoi(argv[++index]);
+		}
+		else if((strncmp(argv[index], "--seed", 6) == 0) && (index + 1 < argc))
+		{
+			s_seed = (uint32_t)strtoul(argv[++index], NULL, 0);
+		}
+		else if((strncmp(argv[index], "--policy", 8) == 0) && (index + 1 < argc))
+		{
+			policyPath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--trace", 7) == 0) && (index + 1 < argc))
+		{
+			tracePath = argv[++index];
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	if((ret != 0) || (s_apps < 1) || (s_modeCount < 1) || (events < 0))
+	{
+		usage();
+		ret = -1;
+	}
+	if(s_seed == 0U)
+	{
+		/* xorshift never leaves zero */
+		s_seed = 1;
+	}
+
+	if(ret == 0)
+	{
+		s_modes = (GenMode *)calloc((size_t)s_apps * (size_t)s_modeCount, sizeof(GenMode));
+		if(s_modes == NULL)
+		{
+			(void)fprintf(stderr, "out of memory\n");
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		FILE *fp = (policyPath != NULL) ? fopen(policyPath, "w") : stdout;
+		GenerateModes();
+		if(fp != NULL)
+		{
+			uint32_t rows = WritePolicy(fp);
+			if(fp != stdout)
+			{
+				(void)fclose(fp);
+			}
+			(void)fprintf(stderr, "policy : %d apps x %d modes, %u rows\n", s_apps, s_modeCount, rows);
+		}
+		else
+		{
+			(void)fprintf(stderr, "can not open %s\n", policyPath);
+			ret = -1;
+		}
+	}
+	if((ret == 0) && (tracePath != NULL))
+	{
+		FILE *fp = fopen(tracePath, "w");
+		if(fp != NULL)
+		{
+			uint32_t written = WriteTrace(fp, (uint32_t)events);
+			(void)fclose(fp);
+			(void)fprintf(stderr, "trace : %u events\n", written);
+		}
+		else
+		{
+			(void)fprintf(stderr, "can not open %s\n", tracePath);
+			ret = -1;
+		}
+	}
+
+	free(s_modes);
+	return (ret == 0) ? 0 : 1;
+}
+
+/* xorshift32, the same seed gives the same policy and trace on every host */
+static uint32_t GenRandom(void)
+{
+	s_seed ^= s_seed << 13;
+	s_seed ^= s_seed >> 17;
+	s_seed ^= s_seed << 5;
+	return s_seed;
+}
+
+static uint32_t GenPick(uint32_t range)
+{
+	return GenRandom() % range;
+}
+
+/*
+ * shaped after defaultmode.xml : mostly level 1 media modes, some level 2
+ * voice modes and level 3 call modes that resume, navigation-like mixing
+ * modes, and a background variant for most of them
+ */
+static void GenerateModes(void)
+{
+	int32_t app;
+	int32_t index;
+	for(app = 0; app < s_apps; app++)
+	{
+		for(index = 0; index < s_modeCount; index++)
+		{
+			GenMode *mode = &s_modes[(app * s_modeCount) + index];
+			uint32_t roll = GenPick(10);
+			mode->level = (roll < 6U) ? 1 : ((roll < 8U) ? 2 : 3);
+			mode->tuner = (((app + 1) % GEN_TUNER_APP) == 0) ? 1 : 0;
+			mode->full = (GenPick(4) == 0U) ? 1 : 0;
+			mode->resume = ((mode->level > 1) || (GenPick(4) == 0U)) ? 1 : 0;
+			mode->mixing = ((mode->level == 1) && (mode->resume != 0) && (GenPick(2) == 0U)) ? 1 : 0;
+			mode->exclusive = (mode->level == 3) ? (int32_t)GenPick(2) : -1;
+			mode->background = (GenPick(3) != 0U) ? 1 : 0;
+		}
+	}
+}
+
+static uint32_t WritePolicy(FILE *fp)
+{
+	uint32_t rows = 0;
+	int32_t app;
+	int32_t index;
+
+	(void)fprintf(fp, "<?xml version=\"1.0\"?>\n");
+	(void)fprintf(fp, "<policies>\n");
+	(void)fprintf(fp, "\t<!-- generated by TCModePolicyGen, %d apps x %d modes -->\n", s_apps, s_modeCount);
+	(void)fprintf(fp, "\t<mode name=\"home\" app=\"0\" audio=\"0\" display=\"1\" full=\"1\"/>\n");
+	(void)fprintf(fp, "\t<mode name=\"view\" app=\"0\" audio=\"0\" display=\"1\" full=\"1\"/>\n");
+	rows += 2U;
+	for(app = 0; app < s_apps; app++)
+	{
+		(void)fprintf(fp, "\n\t<mode name=\"view\" app=\"%d\" audio=\"0\" display=\"1\"/>\n", app + 1);
+		rows++;
+		for(index = 0; index < s_modeCount; index++)
+		{
+			const GenMode *mode = &s_modes[(app * s_modeCount) + index];
+			(void)fprintf(fp, "\t<mode name=\"mode%d\" app=\"%d\" audio=\"%d\" display=\"%d\"",
+						  index, app + 1, mode->level, mode->level);
+			if(mode->tuner != 0)
+			{
+				(void)fprintf(fp, " tuner=\"1\"");
+			}
+			if(mode->full != 0)
+			{
+				(void)fprintf(fp, " full=\"1\"");
+			}
+			if(mode->resume != 0)
+			{
+				(void)fprintf(fp, " resume=\"1\"");
+			}
+			if(mode->mixing != 0)
+			{
+				(void)fprintf(fp, " mixing=\"1\"");
+			}
+			if(mode->exclusive >= 0)
+			{
+				(void)fprintf(fp, " exclusive=\"%d\"", mode->exclusive);
+			}
+			(void)fprintf(fp, "/>\n");
+			rows++;
+			if(mode->background != 0)
+			{
+				(void)fprintf(fp, "\t<mode name=\"mode%dbg\" app=\"%d\" audio=\"%d\" display=\"0\"",
+							  index, app + 1, mode->level);
+				if(mode->tuner != 0)
+				{
+					(void)fprintf(fp, " tuner=\"1\"");
+				}
+				if(mode->resume != 0)
+				{
+					(void)fprintf(fp, " resume=\"1\"");
+				}
+				if(mode->mixing != 0)
+				{
+					(void)fprintf(fp, " mixing=\"1\"");
+				}
+				(void)fprintf(fp, "/>\n");
+				rows++;
+			}
+		}
+	}
+	(void)fprintf(fp, "\n\t<mode name=\"idle\" app=\"-1\"/>\n");
+	(void)fprintf(fp, "</policies>\n");
+	rows++;
+	return rows;
+}
+
+/*
+ * apps change modes at random, end what they started and now and then the
+ * user goes home or the system suspends. release_resource_done is not part
+ * of the trace, replay it with TCModeManagerBench --auto-release.
+ */
+static uint32_t WriteTrace(FILE *fp, uint32_t events)
+{
+	uint32_t written = 0;
+	int32_t *active = (int32_t *)malloc((size_t)s_apps * sizeof(int32_t));
+	int32_t app;
+
+	if(active != NULL)
+	{
+		for(app = 0; app < s_apps; app++)
+		{
+			active[app] = -1;
+		}
+		(void)fprintf(fp, "# TCModePolicyGen --apps %d --modes %d, replay with --auto-release\n",
+					  s_apps, s_modeCount);
+		(void)fprintf(fp, "change_mode home 0\n");
+		written++;
+		while(written < events)
+		{
+			uint32_t roll = GenPick(100);
+			app = (int32_t)GenPick((uint32_t)s_apps);
+			if(roll < 60U)
+			{
+				WriteChange(fp, active, app);
+				written++;
+			}
+			else if((roll < 85U) && (active[app] >= 0))
+			{
+				/* active holds mode * 2 + 1 for its bg variant */
+				(void)fprintf(fp, "end_mode mode%d%s %d\n", active[app] / 2,
+							  ((active[app] % 2) != 0) ? "bg" : "", app + 1);
+				active[app] = -1;
+				written++;
+			}
+			else if(roll < 98U)
+			{
+				(void)fprintf(fp, "change_mode home 0\n");
+				written++;
+			}
+			else
+			{
+				(void)fprintf(fp, "suspend\nresume\n");
+				written += 2U;
+			}
+		}
+		free(active);
+	}
+	else
+	{
+		(void)fprintf(stderr, "out of memory\n");
+	}
+	return written;
+}
+
+static void WriteChange(FILE *fp, int32_t *active, int32_t app)
+{
+	int32_t index = (int32_t)GenPick((uint32_t)s_modeCount + 1U);
+	if(index == s_modeCount)
+	{
+		(void)fprintf(fp, "change_mode view %d\n", app + 1);
+	}
+	else
+	{
+		const GenMode *mode = &s_modes[(app * s_modeCount) + index];
+		int32_t background = ((mode->background != 0) && (GenPick(4) == 0U)) ? 1 : 0;
+		(void)fprintf(fp, "change_mode mode%d%s %d\n", index, (background != 0) ? "bg" : "", app + 1);
+		active[app] = (index * 2) + background;
+	}
+}
+
+static void usage(void)
+{
+	(void)printf("Usage : TCModePolicyGen [OPTIONS]...\n");
+	(void)printf("\t--apps N : apps 1..N, each with a view mode (default 8)\n");
+	(void)printf("\t--modes M : modes per app besides view, most with a bg variant (default 4)\n");
+	(void)printf("\t--seed S : random seed (default 1)\n");
+	(void)printf("\t--policy FILE : write the policy XML to FILE instead of stdout\n");
+	(void)printf("\t--trace FILE : also write an event trace for TCModeManagerBench\n");
+	(void)printf("\t--events K : events in the trace (default %d)\n", GEN_EVENTS_DEFAULT);
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Mode Manager policy scaling sweep
+#
+# Generates policies of APPS x MODES with TCModePolicyGen, replays a trace of
+# EVENTS on each with TCModeManagerBench and prints one CSV row per size and parser :
+#   apps,modes,rows,parser,parse_usec,heap_kib,parse_maxrss_kib,maxrss_kib,events_per_sec,change_p50,change_p99,change_max,run_p50,run_p99
+# latencies are nsec. Keep the output of every release to compare the curves.
+# With BENCH_FLAGS=--inline-arbitration change_p50 and run_p50 are the arbitration
+# itself, policy lookups included, without the hop to the manager thread : they
+# should stay about flat while rows grow, a lookup that scans the rows does not.
+#
+# environment
+#   BENCH_DIR   directory holding TCModePolicyGen and TCModeManagerBench (default .)
+#   APPS        app counts to sweep (default "8 32 128 512")
+#   MODES       modes per app to sweep (default "4 16 64")
+#   EVENTS      events per trace (default 20000)
+#   REPEAT      replays of each trace (default 5)
+#   SEED        generator seed (default 1)
+#   PARSERS     policy parsers to compare, stream and/or dom (default "stream dom")
+#   BENCH_FLAGS extra TCModeManagerBench options, e.g. --inline-arbitration
+#
+
+BENCH_DIR=${BENCH_DIR:-.}
+APPS=${APPS:-"8 32 128 512"}
+MODES=${MODES:-"4 16 64"}
+EVENTS=${EVENTS:-20000}
+REPEAT=${REPEAT:-5}
+SEED=${SEED:-1}
+PARSERS=${PARSERS:-"stream dom"}
+
+WORK=$(mktemp -d /tmp/TCModeScaling.XXXXXX) || exit 1
+trap 'rm -rf "$WORK"' EXIT INT TERM
+
+echo "apps,modes,rows,parser,parse_usec,heap_kib,parse_maxrss_kib,maxrss_kib,events_per_sec,change_p50,change_p99,change_max,run_p50,run_p99"
+for apps in $APPS
+do
+	for modes in $MODES
+	do
+		if ! "$BENCH_DIR/TCModePolicyGen" --apps "$apps" --modes "$modes" --seed "$SEED" --events "$EVENTS" \
+				--policy "$WORK/policy.xml" --trace "$WORK/events.trace" 2>/dev/null
+		then
+			echo "TCModePolicyGen failed for $apps apps x $modes modes" >&2
+			exit 1
+		fi
+		rows=$(grep -c '<mode ' "$WORK/policy.xml")
+		for parser in $PARSERS
+		do
+			flags=$BENCH_FLAGS
+			if [ "$parser" = "dom" ]
+			then
+				flags="$flags --dom-parser"
+			fi
+			summary=$("$BENCH_DIR/TCModeManagerBench" --policy "$WORK/policy.xml" --trace "$WORK/events.trace" \
+					--repeat "$REPEAT" --auto-release --summary $flags | grep '^summary ')
+			if [ -z "$summary" ]
+			then
+				echo "TCModeManagerBench failed for $apps apps x $modes modes, $parser parser" >&2
+				exit 1
+			fi
+			# summary key=value ... -> value,value,...
+			values=$(echo "$summary" | sed -e 's/^summary //' -e 's/[a-z0-9_]*=//g' -e 's/ /,/g')
+			echo "$apps,$modes,$rows,$parser,$values"
+		done
+	done
+done
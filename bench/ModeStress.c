@@ -0,0 +1,297 @@
+/****************************************************************************************
+ *   FileName    : ModeStress.c
+ *   Description : Mode Manager Multi-threaded Stress C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+/*
+ * Several client threads call change_mode, end_mode and release_resource_done at once,
+ * the way the DBus dispatch thread and the inline callers race the manager thread.
+ * Built with --enable-tsan-stress it runs under ThreadSanitizer, which exits non-zero
+ * on the first data race it sees.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+#include "ModeXMLParser.h"
+#include "ModeManager.h"
+#include "ModeTrace.h"
+
+#define STRESS_THREADS_MAX		64
+#define STRESS_RELEASE_MAX		256		/* release_resource signals waiting for an answer */
+
+/* the modes and apps of defaultmode.xml, a pair the policy lacks is refused like on the bus */
+static const char *s_modes[] = {
+	"home", "view", "audioplay", "audioplaybg", "videoplay", "voicerec", "voicerecbg",
+	"navialarm", "navialarmbg", "call", "callbg", "camera", "idle"
+};
+static const int32_t s_apps[] = { 0, 1, 2, 3, 6, 7, 8, 10, 11, 12, 13, 14 };
+
+/* release_resource signals, answered with release_resource_done by the client threads */
+static ReleaseApp s_releases[STRESS_RELEASE_MAX];
+static uint32_t s_releaseCount = 0;
+static pthread_mutex_t s_releaseMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int32_t s_iterations = 20000;
+static const char *s_dumpPath = NULL;
+static uint64_t s_changes = 0;
+static uint64_t s_accepted = 0;
+static uint64_t s_ends = 0;
+static uint64_t s_answers = 0;
+static uint64_t s_signals = 0;
+
+static void StressChangedMode(const char *mode, int32_t app);
+static void StressReleaseResource(int32_t resources, int32_t app);
+static void StressEndedMode(const char *mode, int32_t app);
+static void StressSuspendMode(void);
+static void StressResumeMode(void);
+static int32_t StressTakeRelease(ReleaseApp *release);
+static void *StressClient(void *arg);
+static void usage(void);
+
+int32_t main(int32_t argc, char *argv[])
+{
+	int32_t ret = 0;
+	int32_t index;
+	int32_t threads = 6;
+	int32_t inlineArbitration = 0;
+	const char *policyPath = "defaultmode.xml";
+	pthread_t clients[STRESS_THREADS_MAX];
+	int32_t started = 0;
+
+	TCLogInitialize("MODESTRESS", NULL, 0);
+	TCLogSetLevel(TCLogLevelError);
+
+	for(index = 1; index < argc; index++)
+	{
+		if((strncmp(argv[index], "--policy", 8) == 0) && (index + 1 < argc))
+		{
+			policyPath = argv[++index];
+		}
+		else if((strncmp(argv[index], "--threads", 9) == 0) && (index + 1 < argc))
+		{
+			threads = atoi(argv[++index]);
+		}
+		else if((strncmp(argv[index], "--iterations", 12) == 0) && (index + 1 < argc))
+		{
+			s_iterations = atoi(argv[++index]);
+		}
+		else if((strncmp(argv[index], "--dump", 6) == 0) && (index + 1 < argc))
+		{
+			s_dumpPath = argv[++index];
+		}
+		else if(strncmp(argv[index], "--inline-arbitration", 20) == 0)
+		{
+			inlineArbitration = 1;
+		}
+		else if(strncmp(argv[index], "--debug", 7) == 0)
+		{
+			TCLogSetLevel(TCLogLevelDebug);
+		}
+		else
+		{
+			usage();
+			ret = -1;
+		}
+	}
+	if((ret == 0) && ((threads < 1) || (threads > STRESS_THREADS_MAX) || (s_iterations < 1)))
+	{
+		usage();
+		ret = -1;
+	}
+	if(ret == 0)
+	{
+		ret = parseDoc(policyPath);
+		if(ret != 0)
+		{
+			(void)fprintf(stderr, "can not load the policy %s\n", policyPath);
+		}
+	}
+
+	if(ret == 0)
+	{
+		ModeManagerSignalCB cb;
+		ModeManagerStats stats;
+
+		cb._ChangedMode = StressChangedMode;
+		cb._ReleaseResource = StressReleaseResource;
+		cb._EndedMode = StressEndedMode;
+		cb._SuspendMode = StressSuspendMode;
+		cb._ResumeMode = StressResumeMode;
+		cb._Transition = NULL;
+		setModeManagerSignalCB(&cb);
+		setModeManagerInlineArbitration(inlineArbitration);
+		(void)ModeManagerInitiallize();
+
+		for(index = 0; index < threads; index++)
+		{
+			if(pthread_create(&clients[index], NULL, StressClient, (void *)(intptr_t)index) == 0)
+			{
+				started++;
+			}
+			else
+			{
+				(void)fprintf(stderr, "can not start client %d\n", index);
+				ret = -1;
+			}
+		}
+		for(index = 0; index < started; index++)
+		{
+			(void)pthread_join(clients[index], NULL);
+		}
+
+		getModeManagerStats(&stats);
+		ModeManagerRelease();
+
+		(void)printf("threads %d x %d : %lu change_mode (%lu accepted), %lu end_mode, %lu release_resource_done, %lu signals\n",
+					 started, s_iterations,
+					 (unsigned long)__atomic_load_n(&s_changes, __ATOMIC_RELAXED),
+					 (unsigned long)__atomic_load_n(&s_accepted, __ATOMIC_RELAXED),
+					 (unsigned long)__atomic_load_n(&s_ends, __ATOMIC_RELAXED),
+					 (unsigned long)__atomic_load_n(&s_answers, __ATOMIC_RELAXED),
+					 (unsigned long)__atomic_load_n(&s_signals, __ATOMIC_RELAXED));
+		(void)printf("queue high water %u, dropped %lu, release timeouts %lu\n",
+					 stats.queueHighWater, (unsigned long)stats.queueDropped,
+					 (unsigned long)stats.releaseTimeouts);
+	}
+	return (ret == 0) ? 0 : 1;
+}
+
+static void StressChangedMode(const char *mode, int32_t app)
+{
+	(void)mode;
+	(void)app;
+	(void)__atomic_fetch_add(&s_signals, 1U, __ATOMIC_RELAXED);
+}
+
+static void StressReleaseResource(int32_t resources, int32_t app)
+{
+	(void)__atomic_fetch_add(&s_signals, 1U, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&s_releaseMutex);
+	if(s_releaseCount < STRESS_RELEASE_MAX)
+	{
+		s_releases[s_releaseCount].app = app;
+		s_releases[s_releaseCount].resource = resources;
+		s_releaseCount++;
+	}
+	pthread_mutex_unlock(&s_releaseMutex);
+}
+
+static void StressEndedMode(const char *mode, int32_t app)
+{
+	(void)mode;
+	(void)app;
+	(void)__atomic_fetch_add(&s_signals, 1U, __ATOMIC_RELAXED);
+}
+
+static void StressSuspendMode(void)
+{
+	(void)__atomic_fetch_add(&s_signals, 1U, __ATOMIC_RELAXED);
+}
+
+static void StressResumeMode(void)
+{
+	(void)__atomic_fetch_add(&s_signals, 1U, __ATOMIC_RELAXED);
+}
+
+static int32_t StressTakeRelease(ReleaseApp *release)
+{
+	int32_t ret = -1;
+	pthread_mutex_lock(&s_releaseMutex);
+	if(s_releaseCount > 0U)
+	{
+		s_releaseCount--;
+		*release = s_releases[s_releaseCount];
+		ret = 0;
+	}
+	pthread_mutex_unlock(&s_releaseMutex);
+	return ret;
+}
+
+static void *StressClient(void *arg)
+{
+	uint32_t seed = ((uint32_t)(intptr_t)arg * 7919U) + 1U;
+	int32_t iteration;
+
+	for(iteration = 0; iteration < s_iterations; iteration++)
+	{
+		const char *mode;
+		int32_t app;
+		ReleaseApp release;
+
+		seed = (seed * 1103515245U) + 12345U;
+		mode = s_modes[(seed >> 8) % (sizeof(s_modes) / sizeof(s_modes[0]))];
+		app = s_apps[(seed >> 16) % (sizeof(s_apps) / sizeof(s_apps[0]))];
+		switch((seed >> 4) % 4U)
+		{
+			case 0:
+			case 1:
+				if(cmpModePriority(mode, app) == 0)
+				{
+					(void)__atomic_fetch_add(&s_accepted, 1U, __ATOMIC_RELAXED);
+				}
+				(void)__atomic_fetch_add(&s_changes, 1U, __ATOMIC_RELAXED);
+				break;
+			case 2:
+				resumeMode(mode, app);
+				(void)__atomic_fetch_add(&s_ends, 1U, __ATOMIC_RELAXED);
+				break;
+			default:
+				/* answer a release_resource if one waits, else an unasked release_resource_done */
+				if(StressTakeRelease(&release) != 0)
+				{
+					release.app = app;
+					release.resource = (int32_t)((seed >> 20) & 0x7U);
+				}
+				sendModeChanged(release.resource, release.app);
+				(void)__atomic_fetch_add(&s_answers, 1U, __ATOMIC_RELAXED);
+				break;
+		}
+		if((iteration % 5000) == 4999)
+		{
+			systemSuspendMode();
+			systemResumeMode();
+			/* the flight recorder is read while the others keep appending */
+			if(s_dumpPath != NULL)
+			{
+				(void)ModeTraceDump(s_dumpPath);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void usage(void)
+{
+	(void)printf("Usage : TCModeStress [OPTIONS]...\n");
+	(void)printf("\t--policy FILE : mode policy (default defaultmode.xml)\n");
+	(void)printf("\t--threads N : client threads (default 6, at most %d)\n", STRESS_THREADS_MAX);
+	(void)printf("\t--iterations N : calls per client thread (default 20000)\n");
+	(void)printf("\t--dump FILE : dump the trace to FILE now and then while the clients run\n");
+	(void)printf("\t--inline-arbitration : arbitrate on the calling threads\n");
+	(void)printf("\t--debug : debug log on\n");
+}
@@ -38,6 +38,20 @@ between Telechips and Company.
 #define MODE_ERROR_OCCURED								"mode_error_occured"
 #define SUSPEND											"suspend"
 #define RESUME											"resume"
+#define GET_STATS										"get_stats"
+#define DUMP_TRACE										"dump_trace"
+#define RELOAD_POLICY									"reload_policy"
+#define REGISTER_APP									"register_app"		/* needed for crash recovery, see ModeDBusManager.c */
+#define CHANGE_MODES									"change_modes"
+
+/* change_modes calls taken in one batch, the ones past it are refused */
+#define CHANGE_MODES_MAX								32
+
+/* register_app id of an observer, it gets a copy of every signal sent to it */
+#define MODE_APP_OBSERVER								(-1)
+
+/* register_app error reply, the app id is bound to another name still on the bus */
+#define MODE_ERROR_APP_BOUND							"mode.manager.Error.AppBound"
 
 typedef enum{
 	ChangeMode,
@@ -46,6 +60,11 @@ typedef enum{
 	ModeErrorOccured,
 	Suspend,
 	Resume,
+	GetStats,
+	DumpTrace,
+	ReloadPolicy,
+	RegisterApp,
+	ChangeModes,
 	TotalMethodModeManagerEvent
 }MethodModeManagerEvent;
 extern const char* g_methodModeManagerEventNames[TotalMethodModeManagerEvent];
@@ -56,6 +75,7 @@ extern const char* g_methodModeManagerEventNames[TotalMethodModeManagerEvent];
 #define ENDED_MODE										"ended_mode"
 #define SUSPEND_MODE									"suspend_mode"
 #define RESUME_MODE										"resume_mode"
+#define TRANSITION										"transition"
 
 typedef enum{
 	ChangedMode,
@@ -63,6 +83,7 @@ typedef enum{
 	EndedMode,
 	SuspendMode,
 	ResumeMode,
+	Transition,
 	TotalSignalModeManagerEvent
 }SignalModeManagerEvent;
 extern const char* g_signalModeManagerEventNames[TotalSignalModeManagerEvent];
@@ -0,0 +1,62 @@
+/****************************************************************************************
+ *   FileName    : ModeArray.h
+ *   Description : Mode Growable Array Header File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef MODE_ARRAY_H
+#define MODE_ARRAY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Room for one more element past count in an array of size elements, doubling from 64.
+ * Returns the array, moved if it grew, or NULL with the old one still valid.
+ */
+static inline void *ModeArrayGrow(void *array, uint32_t *size, uint32_t count, size_t unit)
+{
+	void *ret = array;
+	if(count >= *size)
+	{
+		uint32_t grown = (*size == 0U) ? 64U : *size;
+		while(count >= grown)
+		{
+			grown *= 2U;
+		}
+		ret = realloc(array, grown * unit);
+		if(ret != NULL)
+		{
+			*size = grown;
+		}
+	}
+	return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
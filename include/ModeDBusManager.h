@@ -27,6 +27,8 @@ between Telechips and Company.
 #ifndef MODE_DBUS_MANAGER_H
 #define MODE_DBUS_MANAGER_H
 
+#include "ModeManager.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +42,7 @@ void SendDBusReleaseResource(int32_t resources, int32_t app);
 void SendDBusEndedMode(const char *mode, int32_t app);
 void SendDBusSuspendMode(void);
 void SendDBusResumeMode(void);
+void SendDBusTransition(const ModeSignal *signals, int32_t count);
 
 #ifdef __cplusplus
 }
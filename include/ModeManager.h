@@ -33,6 +33,16 @@ extern "C" {
 
 extern int32_t g_debug;
 
+#define MODE_RESOURCE_KINDS_MAX		8	/* display, audio and tuner included */
+#define MODE_RESOURCE_NAME_MAX		16
+
+/* level of a resource kind the policy declares with <resource> beyond the built-in ones */
+typedef struct
+{
+	char name[MODE_RESOURCE_NAME_MAX];
+	int32_t level;
+} ModeResourceLevel;
+
 typedef struct
 {
 	char mode[128];
@@ -44,32 +54,145 @@ typedef struct
 	int32_t resume;
 	int32_t mixing;
 	int32_t exclusive;
+	uint32_t resourceCount;
+	ModeResourceLevel resources[MODE_RESOURCE_KINDS_MAX - 3];
 } Mode;
 
+typedef struct
+{
+	int32_t app;
+	int32_t resource;
+} ReleaseApp;
+
 typedef void (*ChangedMode_cb)(const char *mode, int32_t app);
 typedef void (*ReleaseResource_cb)(int32_t resources, int32_t app);
 typedef void (*EndedMode_cb)(const char *mode, int32_t app);
 typedef void (*SuspendMode_cb)(void);
 typedef void (*ResumeMode_cb)(void);
 
+/* ModeSignal.event, in SignalModeManagerEvent order */
+#define MODE_SIGNAL_CHANGED_MODE		0
+#define MODE_SIGNAL_RELEASE_RESOURCE	1
+#define MODE_SIGNAL_ENDED_MODE			2
+#define MODE_SIGNAL_SUSPEND_MODE		3
+#define MODE_SIGNAL_RESUME_MODE			4
+
+/* one signal of a transition */
+typedef struct
+{
+	int32_t event;				/* MODE_SIGNAL_xxx */
+	const char *mode;			/* "" but for changed_mode and ended_mode */
+	int32_t app;				/* -1 for suspend_mode and resume_mode */
+	int32_t resources;			/* release_resource only */
+} ModeSignal;
+
+/* the coalesced signals of one request, MODE_SIGNAL_TRANSITION */
+typedef void (*Transition_cb)(const ModeSignal *signals, int32_t count);
+
+/* setModeManagerSignalBatch() */
+#define MODE_SIGNAL_DIRECT		0	/* every signal goes out as it is raised */
+#define MODE_SIGNAL_BATCH		1	/* the signals of one request are coalesced and sent back to back */
+#define MODE_SIGNAL_TRANSITION	2	/* coalesced as MODE_SIGNAL_BATCH and sent as one Transition_cb call */
+
+/* change_mode result of a request a newer one of the same app took the place of before it ran */
+#define MODE_CHANGE_SUPERSEDED	(-1)
+
+/* setModeManagerDecisionCache() */
+#define MODE_DECISION_OFF		0	/* walk the stacks for every change_mode */
+#define MODE_DECISION_CACHE		1	/* answer a state seen before from the decision cache */
+#define MODE_DECISION_VERIFY	2	/* walk the stacks and check the cache against the walk */
+
+/* inline arbitration only, ask the host to call processModeManagerTimer() in msec */
+typedef void (*ModeTimer_cb)(int32_t msec);
+
+typedef struct
+{
+	uint32_t wakeupsPerSec;		/* manager thread wakeups during the last second */
+	uint64_t wakeups;			/* manager thread wakeups since start */
+	uint32_t queueDepth;		/* commands waiting for the manager thread */
+	uint32_t queueHighWater;	/* deepest the command queue has been */
+	uint64_t queueDropped;		/* commands refused because the queue was full */
+	uint64_t releaseTimeouts;	/* release_resource handshakes forced by their deadline */
+	uint64_t decisionHits;		/* change_mode answered from the decision cache */
+	uint64_t decisionMisses;	/* change_mode decided by walking the stacks */
+	uint64_t decisionMismatches;	/* cached decisions the stack walk disagreed with, MODE_DECISION_VERIFY */
+	uint32_t decisionStates;	/* stack states the cache holds decisions for */
+	uint64_t signalsSent;		/* signals handed to the host */
+	uint64_t signalsCoalesced;	/* signals dropped as superseded within their request */
+	uint64_t requestsSuperseded;	/* queued change_mode answered MODE_CHANGE_SUPERSEDED */
+	uint64_t requestsMerged;	/* change_mode that joined the same one still queued */
+} ModeManagerStats;
+
+typedef struct
+{
+	int32_t app;
+	uint32_t count;
+} ModeAppCounter;
+
+typedef struct
+{
+	int32_t app;
+	uint32_t superseded;
+	uint32_t merged;
+} ModeAppCoalesce;
+
+/* fills the policy through setModePolicy() and setModeResource(), 0 on success */
+typedef int32_t (*ModePolicyLoad_cb)(void);
+
+/* result of a change_mode, called once the new stacks are committed and signalled */
+typedef void (*ChangeModeReply_cb)(int32_t result, const char *mode, int32_t app,
+								   const ReleaseApp *released, int32_t count, void *user);
+
+/* ModeBatchItem.op */
+#define MODE_BATCH_CHANGE		0	/* change_mode */
+#define MODE_BATCH_END			1	/* end_mode */
+
+/* one call of a change_modes batch, result and changed are filled once the batch ran */
+typedef struct
+{
+	const char *mode;
+	int32_t app;
+	int32_t op;					/* MODE_BATCH_xxx */
+	int32_t result;				/* change_mode result, 0 for end_mode or an unknown op */
+	char changed[sizeof(((Mode *)0)->mode)];	/* mode that runs, the bg variant if the display was refused, "" if none */
+} ModeBatchItem;
+
 typedef struct _ModeManagerSignalCB {
 	ChangedMode_cb			_ChangedMode;
 	ReleaseResource_cb		_ReleaseResource;
 	EndedMode_cb			_EndedMode;
 	SuspendMode_cb			_SuspendMode;
 	ResumeMode_cb			_ResumeMode;
+	Transition_cb			_Transition;	/* NULL sends MODE_SIGNAL_TRANSITION one signal at a time */
 } ModeManagerSignalCB;
 
 int32_t ModeManagerInitiallize();
 void ModeManagerRelease();
 
+void setModeManagerInlineArbitration(int32_t enable);
+void setModeManagerDecisionCache(int32_t mode);
+void setModeManagerSignalBatch(int32_t mode);
+void setModeManagerCoalesce(int32_t enable);
 void setModeManagerSignalCB(ModeManagerSignalCB *cb);
+void setModeManagerTimerCB(ModeTimer_cb cb);
 void setModePolicy(Mode policy);
+int32_t setModeReleaseTimeout(const char* resource, int32_t msec);
+int32_t setModeResource(const char* resource, int32_t mask, int32_t msec);
+void setModePolicyLoadCB(ModePolicyLoad_cb cb);
+int32_t reloadModePolicy();
 int32_t cmpModePriority(const char* mode, int32_t app);
+void cmpModePriorityAsync(const char* mode, int32_t app, ChangeModeReply_cb reply, void *user);
+int32_t changeModes(ModeBatchItem *items, int32_t count);
+void changeModesAsync(ModeBatchItem *items, int32_t count, ChangeModeReply_cb reply, void *user);
 void resumeMode(const char* mode, int32_t app);
 void sendModeChanged(int32_t resources, int32_t app);
 void systemSuspendMode();
 void systemResumeMode();
+void shutdownMode(int32_t app);
+void processModeManagerTimer();
+void getModeManagerStats(ModeManagerStats *stats);
+int32_t getModeReleaseTimeouts(ModeAppCounter *counters, int32_t max);
+int32_t getModeCoalescedRequests(ModeAppCoalesce *counters, int32_t max);
 
 
 
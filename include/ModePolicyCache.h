@@ -0,0 +1,111 @@
+
+/****************************************************************************************
+ *   FileName    : ModePolicyCache.h
+ *   Description : Mode Policy Binary Cache Header File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef MODE_POLICY_CACHE_H
+#define MODE_POLICY_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODE_POLICY_CACHE_MAGIC		"MODEPOL"
+#define MODE_POLICY_CACHE_VERSION	3
+#define MODE_POLICY_CACHE_FILE		"/var/cache/TCModeManager.policy"
+
+typedef struct
+{
+	uint32_t name;				/* string offset */
+	int32_t app;
+	int32_t audio;
+	int32_t display;
+	int32_t tuner;
+	int32_t full;
+	int32_t resume;
+	int32_t mixing;
+	int32_t exclusive;
+	uint32_t levelFirst;		/* ModePolicyCacheLevel index */
+	uint32_t levelCount;
+} ModePolicyCacheMode;
+
+/* level of a declared resource kind in one mode */
+typedef struct
+{
+	uint32_t name;				/* string offset */
+	int32_t level;
+} ModePolicyCacheLevel;
+
+typedef struct
+{
+	uint32_t name;				/* string offset */
+	int32_t mask;				/* RELEASExxx bit, 0 if not given */
+	int32_t timeout;			/* msec */
+} ModePolicyCacheResource;
+
+typedef struct
+{
+	uint32_t path;				/* string offset */
+	uint32_t reserved;
+	uint64_t time;				/* XML mtime in nsec */
+	uint64_t size;
+} ModePolicyCacheSource;
+
+/*
+ * cache file : ModePolicyCacheHeader, sourceCount ModePolicyCacheSources, modeCount
+ * ModePolicyCacheModes in policy order, levelCount ModePolicyCacheLevels the modes point
+ * into, resourceCount ModePolicyCacheResources, then stringSize bytes of NUL terminated
+ * names, each stored once. Host byte order, checksum
+ * is FNV-1a over everything after the header. The cache is stale unless its sources,
+ * in order, still describe the XML files it was compiled from.
+ */
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t modeSize;
+	uint32_t resourceSize;
+	uint32_t modeCount;
+	uint32_t resourceCount;
+	uint32_t stringSize;
+	uint32_t checksum;
+	uint32_t sourceSize;
+	uint32_t sourceCount;		/* base policy, then its overlays */
+	uint32_t levelSize;
+	uint32_t levelCount;
+	uint32_t reserved[2];		/* keeps the sources 8 byte aligned */
+} ModePolicyCacheHeader;
+
+void ModePolicyCacheBegin(void);
+void ModePolicyCacheAddMode(const Mode *mode);
+void ModePolicyCacheAddResource(const char *name, int32_t mask, int32_t timeout);
+int32_t ModePolicyCacheWrite(const char *path, const char *const *sources, uint32_t count);
+void ModePolicyCacheEnd(void);
+int32_t ModePolicyCacheLoad(const char *path, const char *const *sources, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,163 @@
+/****************************************************************************************
+ *   FileName    : ModeStatePage.h
+ *   Description : Mode Shared State Page Header File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef MODE_STATE_PAGE_H
+#define MODE_STATE_PAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODE_STATE_PAGE_MAGIC		"MODESTA"
+#define MODE_STATE_PAGE_VERSION		1
+#define MODE_STATE_PAGE_FILE		"/dev/shm/TCModeManager.state"
+#define MODE_STATE_PAGE_KINDS		8		/* MODE_RESOURCE_KINDS_MAX */
+#define MODE_STATE_PAGE_RESOURCE	16		/* MODE_RESOURCE_NAME_MAX */
+#define MODE_STATE_PAGE_MODE		32		/* longer mode names are cut, modeId stays exact */
+#define MODE_STATE_PAGE_RETRIES		1024	/* reads tried before ModeStatePageRead() gives up */
+
+/* the mode on top of one resource stack */
+typedef struct
+{
+	char resource[MODE_STATE_PAGE_RESOURCE];	/* "display", "audio", "tuner", then the declared kinds */
+	char mode[MODE_STATE_PAGE_MODE];			/* "" if nobody holds the resource */
+	int32_t modeId;				/* interned mode id, -1 if nobody */
+	int32_t app;				/* -1 if nobody */
+	int32_t mask;				/* release_resource bit of the resource */
+	uint32_t depth;				/* modes stacked, the top one included */
+	uint8_t full;
+	uint8_t mixing;
+	uint8_t resume;
+	uint8_t reserved;
+} ModeStateResource;
+
+/*
+ * /dev/shm page the daemon rewrites after every committed change of the resource stacks.
+ * seq is odd while the daemon writes, a reader copies the page between two equal even
+ * reads of seq. generation counts the commits. closed is set when the daemon exits, a new
+ * daemon publishes a new page under the same name, so a client attaches again. Host
+ * byte order.
+ */
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t size;				/* sizeof(ModeStatePage) */
+	uint32_t seq;
+	uint32_t count;				/* resources in use */
+	uint64_t generation;
+	uint32_t closed;
+	uint32_t reserved;
+	ModeStateResource resources[MODE_STATE_PAGE_KINDS];
+} ModeStatePage;
+
+/* daemon side, see ModeStatePage.c */
+int32_t ModeStatePageOpen(const char *path);
+ModeStateResource *ModeStatePageBegin(void);
+void ModeStatePageCommit(uint32_t count);
+void ModeStatePageClose(void);
+
+/* client side, one mmap at attach then plain loads */
+static inline const ModeStatePage *ModeStatePageAttach(const char *path)
+{
+	const ModeStatePage *ret = NULL;
+	struct stat info;
+	int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd >= 0)
+	{
+		if((fstat(fd, &info) == 0) && ((size_t)info.st_size >= sizeof(ModeStatePage)))
+		{
+			void *map = mmap(NULL, sizeof(ModeStatePage), PROT_READ, MAP_SHARED, fd, 0);
+			if(map != MAP_FAILED)
+			{
+				ret = (const ModeStatePage *)map;
+				if((memcmp(ret->magic, MODE_STATE_PAGE_MAGIC, sizeof(MODE_STATE_PAGE_MAGIC)) != 0) ||
+				   (ret->version != MODE_STATE_PAGE_VERSION) || (ret->size != sizeof(ModeStatePage)))
+				{
+					(void)munmap(map, sizeof(ModeStatePage));
+					ret = NULL;
+				}
+			}
+		}
+		(void)close(fd);
+	}
+	return ret;
+}
+
+static inline void ModeStatePageDetach(const ModeStatePage *page)
+{
+	if(page != NULL)
+	{
+		(void)munmap((void *)page, sizeof(ModeStatePage));
+	}
+}
+
+/* 0 with a consistent copy of the page, -1 if the daemon stayed in the middle of a write */
+static inline int32_t ModeStatePageRead(const ModeStatePage *page, ModeStatePage *copy)
+{
+	int32_t ret = -1;
+	uint32_t retry;
+	for(retry = 0; (retry < MODE_STATE_PAGE_RETRIES) && (ret != 0); retry++)
+	{
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if((seq & 1U) == 0U)
+		{
+			(void)memcpy(copy, page, sizeof(ModeStatePage));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+			{
+				ret = 0;
+			}
+		}
+	}
+	return ret;
+}
+
+/* the copied entry of a resource by name, NULL if the policy has no such resource */
+static inline const ModeStateResource *ModeStatePageFind(const ModeStatePage *copy, const char *resource)
+{
+	const ModeStateResource *ret = NULL;
+	uint32_t index;
+	for(index = 0; (index < copy->count) && (index < MODE_STATE_PAGE_KINDS) && (ret == NULL); index++)
+	{
+		if(strncmp(copy->resources[index].resource, resource, MODE_STATE_PAGE_RESOURCE) == 0)
+		{
+			ret = &copy->resources[index];
+		}
+	}
+	return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,73 @@
+
+/****************************************************************************************
+ *   FileName    : ModeStats.h
+ *   Description : Mode Latency Statistics Header
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef MODE_STATS_H
+#define MODE_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum{
+	ModeStatsChangeMode,
+	ModeStatsEndMode,
+	ModeStatsReleaseResourceDone,
+	ModeStatsSuspend,
+	ModeStatsResume,
+	ModeStatsChangeModes,
+	TotalModeStatsMethod
+}ModeStatsMethod;
+
+typedef enum{
+	ModeStatsDispatch,		/* method handler in OnReceivedMethodCall */
+	ModeStatsQueue,			/* waiting in the command queue */
+	ModeStatsRun,			/* arbitration and signals on the manager thread */
+	ModeStatsResources,		/* ModeManagerResources, change_mode only */
+	ModeStatsTotal,			/* queued until done, what cmpModePriority waits for */
+	TotalModeStatsStage
+}ModeStatsStage;
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t p50;			/* nsec, upper bound of the histogram bucket */
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t max;
+} ModeStatsSummary;
+
+extern const char *g_modeStatsMethodNames[TotalModeStatsMethod];
+extern const char *g_modeStatsStageNames[TotalModeStatsStage];
+
+uint64_t ModeStatsNow(void);
+void ModeStatsRecord(int32_t method, int32_t stage, uint64_t nsec);
+void ModeStatsSummarize(int32_t method, int32_t stage, ModeStatsSummary *summary);
+void ModeStatsDump(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
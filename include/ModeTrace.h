@@ -0,0 +1,97 @@
+
+/****************************************************************************************
+ *   FileName    : ModeTrace.h
+ *   Description : Mode Flight Recorder Header
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef MODE_TRACE_H
+#define MODE_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODE_TRACE_MAGIC		"MODETRC"
+#define MODE_TRACE_VERSION		1
+#define MODE_TRACE_RECORDS		4096		/* power of two */
+#define MODE_TRACE_DIR			"/run/TCModeManager"		/* created 0700 by the first dump */
+#define MODE_TRACE_FILE			MODE_TRACE_DIR "/TCModeManager.trace"
+
+typedef enum{
+	ModeTraceQueued,			/* arg : MODE_REQ_xxx, time is when it was queued */
+	ModeTraceChange,			/* arg : change_mode result, mode : resulting mode */
+	ModeTraceEndMode,
+	ModeTraceReleaseDone,		/* arg : resources */
+	ModeTraceReleaseTimeout,	/* arg : resources forced */
+	ModeTraceShutdown,
+	ModeTraceSuspend,
+	ModeTraceResume,
+	ModeTraceChangedMode,		/* changed_mode signal */
+	ModeTraceReleaseResource,	/* release_resource signal, arg : resources */
+	ModeTraceEndedMode,			/* ended_mode signal */
+	ModeTraceReload,			/* policy swapped in, arg : modes in it */
+	TotalModeTraceEvent
+}ModeTraceEvent;
+
+/* one event, the stack depths are taken right after it */
+typedef struct
+{
+	uint64_t time;				/* CLOCK_MONOTONIC nsec */
+	uint32_t seq;				/* filled by ModeTraceAppend() */
+	uint16_t event;				/* ModeTraceEvent */
+	int16_t app;
+	int32_t mode;				/* interned mode id, -1 if none */
+	int32_t arg;
+	uint8_t audio;				/* _audio depth */
+	uint8_t display;			/* _display depth */
+	uint8_t tuner;				/* _tuner depth */
+	uint8_t release;			/* apps in _relAppList */
+	int8_t audioDelta;			/* depth change since the previous event */
+	int8_t displayDelta;
+	int8_t tunerDelta;
+	int8_t releaseDelta;
+} ModeTraceRecord;
+
+/*
+ * dump file : ModeTraceHeader, nameCount names as (uint16_t length, bytes) indexed by
+ * mode id, then recordCount ModeTraceRecords oldest first. Host byte order.
+ */
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t recordCount;
+	uint32_t nameCount;
+	uint64_t monotonicTime;		/* CLOCK_MONOTONIC nsec at dump */
+	uint64_t realTime;			/* CLOCK_REALTIME nsec at dump */
+} ModeTraceHeader;
+
+void ModeTraceAppend(ModeTraceRecord *record);
+void ModeTraceName(int32_t id, const char *name);
+int32_t ModeTraceDump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
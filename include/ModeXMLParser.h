@@ -27,7 +27,12 @@ between Telechips and Company.
 #ifndef MODE_XML_PARSER_H
 #define MODE_XML_PARSER_H
 
+#define MODE_POLICY_DIR		"/etc/mode/policy.d"
+
 int32_t parseDoc(const char *docname);
+int32_t parseDocDOM(const char *docname);		/* bench/ModePolicyDOM.c, TCModeManagerBench only */
+int32_t parseDocCached(const char *docname, const char *cachename);
+int32_t parseDocSet(const char *docname, const char *overlaydir, const char *cachename);
 
 #endif
 
@@ -33,7 +33,12 @@ const char *g_methodModeManagerEventNames[TotalMethodModeManagerEvent] = {
 	END_MODE,
 	MODE_ERROR_OCCURED,
 	SUSPEND,
-	RESUME
+	RESUME,
+	GET_STATS,
+	DUMP_TRACE,
+	RELOAD_POLICY,
+	REGISTER_APP,
+	CHANGE_MODES
 };
 
 const char *g_signalModeManagerEventNames[TotalSignalModeManagerEvent] = {
@@ -41,5 +46,6 @@ const char *g_signalModeManagerEventNames[TotalSignalModeManagerEvent] = {
 	RELEASE_RESOURCE,
 	ENDED_MODE,
 	SUSPEND_MODE,
-	RESUME_MODE
+	RESUME_MODE,
+	TRANSITION
 };
@@ -35,6 +35,10 @@ between Telechips and Company.
 #include "DBusMsgDef.h"
 #include "ModeDBusManager.h"
 #include "ModeManager.h"
+#include "ModeStats.h"
+#include "ModeTrace.h"
+
+#define DBUS_STATS_APPS_MAX		32
 
 typedef void (*DBusMethodCallFunction)(DBusMessage *message);
 
@@ -44,7 +48,24 @@ static void DBusMethodEndMode(DBusMessage *message);
 static void DBusMethodModeErrorOcuured(DBusMessage *message);
 static void DBusMethodSuspend(DBusMessage *message);
 static void DBusMethodResume(DBusMessage *message);
+static void DBusMethodGetStats(DBusMessage *message);
+static void DBusMethodDumpTrace(DBusMessage *message);
+static void DBusMethodReloadPolicy(DBusMessage *message);
+static void DBusMethodRegisterApp(DBusMessage *message);
+static void DBusMethodChangeModes(DBusMessage *message);
+static void DBusReplyChangeModes(int32_t result, const char *mode, int32_t app,
+								 const ReleaseApp *released, int32_t count, void *user);
+static gboolean DBusReloadPolicy(gpointer user_data);
+static void DBusAppendCounter(DBusMessageIter *array, const char *name, uint64_t value);
 static DBusMsgErrorCode OnReceivedMethodCall(DBusMessage *message, const char *interface);
+static DBusMsgErrorCode OnReceivedSignal(DBusMessage *message, const char *interface);
+static void DBusTrackClient(const char *name, int32_t app);
+static void DBusClientGone(const char *name);
+static gboolean DBusAppNameIs(gpointer key, gpointer value, gpointer user_data);
+static void DBusSendAppSignal(DBusMessage *message, int32_t app);
+static void DBusSendSignalCopy(DBusMessage *message, const char *name);
+static void DBusReplyChangeMode(int32_t result, const char *mode, int32_t app,
+								const ReleaseApp *released, int32_t count, void *user);
 
 
 static DBusMethodCallFunction s_DBusMethodProcess[TotalMethodModeManagerEvent] = {
@@ -54,13 +75,64 @@ static DBusMethodCallFunction s_DBusMethodProcess[TotalMethodModeManagerEvent] =
 	DBusMethodModeErrorOcuured,
 	DBusMethodSuspend,
 	DBusMethodResume,
+	DBusMethodGetStats,
+	DBusMethodDumpTrace,
+	DBusMethodReloadPolicy,
+	DBusMethodRegisterApp,
+	DBusMethodChangeModes,
+};
+
+/* MethodModeManagerEvent -> ModeStatsMethod, -1 for methods that are not measured */
+static const int32_t s_DBusMethodStats[TotalMethodModeManagerEvent] = {
+	ModeStatsChangeMode,
+	ModeStatsReleaseResourceDone,
+	ModeStatsEndMode,
+	-1,
+	ModeStatsSuspend,
+	ModeStatsResume,
+	-1,
+	-1,
+	-1,
+	-1,
+	ModeStatsChangeModes,
 };
 
+/*
+ * unique bus name of a client -> set of the app ids it registered as its own. Apps named
+ * in change_mode and friends are not taken for the caller's, an HMI or a launcher acts
+ * for others. When the name drops off the bus the apps still bound to it are reclaimed
+ * as if they had gone idle. A client that never calls register_app is not tracked, its
+ * resources stay held after it crashes until the app's next change_mode or end_mode.
+ */
+static GHashTable *s_clientApps = NULL;
+static GMutex s_clientMutex;
+
+/*
+ * app id -> unique bus name bound by register_app. Signals for a registered app are sent
+ * to that name only, the other apps do not wake up for them. Observers register with
+ * MODE_APP_OBSERVER and each gets its own unicast copy. Both are guarded by s_clientMutex,
+ * signals are sent from the manager thread.
+ */
+static GHashTable *s_appNames = NULL;
+static GHashTable *s_observers = NULL;
+
+/* a change_modes in flight, the mode strings point into message, which it holds */
+typedef struct
+{
+	DBusMessage *message;
+	int32_t count;
+	ModeBatchItem items[CHANGE_MODES_MAX];
+} DBusChangeModes;
+
 void ModeDBusInitialize(void)
 {
 	SetDBusPrimaryOwner(MODEMANAGER_PROCESS_DBUS_NAME);
-	SetCallBackFunctions(NULL, OnReceivedMethodCall);
+	s_clientApps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+	s_appNames = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	s_observers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	SetCallBackFunctions(OnReceivedSignal, OnReceivedMethodCall);
 	(void)AddMethodInterface(MODEMANAGER_EVENT_INTERFACE);
+	(void)AddSignalInterface(DBUS_INTERFACE_DBUS);
 	InitializeRawDBusConnection("MODE MANAGER DBUS");
 	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
 }
@@ -68,6 +140,23 @@ void ModeDBusInitialize(void)
 void ModeDBusRelease(void)
 {
 	ReleaseRawDBusConnection();
+	g_mutex_lock(&s_clientMutex);
+	if(s_clientApps != NULL)
+	{
+		g_hash_table_destroy(s_clientApps);
+		s_clientApps = NULL;
+	}
+	if(s_appNames != NULL)
+	{
+		g_hash_table_destroy(s_appNames);
+		s_appNames = NULL;
+	}
+	if(s_observers != NULL)
+	{
+		g_hash_table_destroy(s_observers);
+		s_observers = NULL;
+	}
+	g_mutex_unlock(&s_clientMutex);
 	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
 }
 
@@ -84,14 +173,8 @@ void SendDBusChangedMode(const char *mode, int32_t app)
 								  DBUS_TYPE_INVALID);
 	if(message != NULL)
 	{
-		if(SendDBusMessage(message, NULL) == 1)
-		{
-			TCLog(TCLogLevelDebug, "%s : %s, %d\n", __FUNCTION__, dbusMode, dbusApp);
-		}
-		else
-		{
-			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
-		}
+		TCLog(TCLogLevelDebug, "%s : %s, %d\n", __FUNCTION__, dbusMode, dbusApp);
+		DBusSendAppSignal(message, dbusApp);
 		dbus_message_unref(message);
 	}
 	else
@@ -113,14 +196,8 @@ void SendDBusReleaseResource(int32_t resources, int32_t app)
 								  DBUS_TYPE_INVALID);
 	if(message != NULL)
 	{
-		if(SendDBusMessage(message, NULL) == 1)
-		{
-			TCLog(TCLogLevelDebug, "%s: %d, %d\n", __FUNCTION__, dbusResources, dbusApp);
-		}
-		else
-		{
-			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
-		}
+		TCLog(TCLogLevelDebug, "%s: %d, %d\n", __FUNCTION__, dbusResources, dbusApp);
+		DBusSendAppSignal(message, dbusApp);
 		dbus_message_unref(message);
 	}
 	else
@@ -140,10 +217,29 @@ void SendDBusEndedMode(const char* mode, int32_t app)
 								  DBUS_TYPE_INT32, &dbusApp,
 								  DBUS_TYPE_INVALID);
 	if(message != NULL)
+	{
+		TCLog(TCLogLevelDebug, "%s: %s, %d\n", __FUNCTION__, dbusMode, dbusApp);
+		DBusSendAppSignal(message, dbusApp);
+		dbus_message_unref(message);
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+
+void SendDBusSuspendMode(void)
+{
+	DBusMessage *message;
+
+	message = CreateDBusMsgSignal(MODEMANAGER_PROCESS_OBJECT_PATH, MODEMANAGER_EVENT_INTERFACE,
+								  g_signalModeManagerEventNames[SuspendMode],
+								  DBUS_TYPE_INVALID);
+	if(message != NULL)
 	{
 		if(SendDBusMessage(message, NULL) == 1)
 		{
-			TCLog(TCLogLevelDebug, "%s: %s, %d\n", __FUNCTION__, dbusMode, dbusApp);
+			TCLog(TCLogLevelDebug, "%s\n", __FUNCTION__);
 		}
 		else
 		{
@@ -157,12 +253,12 @@ void SendDBusEndedMode(const char* mode, int32_t app)
 	}
 }
 
-void SendDBusSuspendMode(void)
+void SendDBusResumeMode(void)
 {
 	DBusMessage *message;
 
 	message = CreateDBusMsgSignal(MODEMANAGER_PROCESS_OBJECT_PATH, MODEMANAGER_EVENT_INTERFACE,
-								  g_signalModeManagerEventNames[SuspendMode],
+								  g_signalModeManagerEventNames[ResumeMode],
 								  DBUS_TYPE_INVALID);
 	if(message != NULL)
 	{
@@ -182,18 +278,46 @@ void SendDBusSuspendMode(void)
 	}
 }
 
-void SendDBusResumeMode(void)
+/*
+ * every signal of one transition in order, a(ssii) of signal name, mode, app and resources,
+ * mode is "" and app -1 where the single signal has none
+ */
+void SendDBusTransition(const ModeSignal *signals, int32_t count)
 {
 	DBusMessage *message;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	DBusMessageIter entry;
+	int32_t index;
 
 	message = CreateDBusMsgSignal(MODEMANAGER_PROCESS_OBJECT_PATH, MODEMANAGER_EVENT_INTERFACE,
-								  g_signalModeManagerEventNames[ResumeMode],
+								  g_signalModeManagerEventNames[Transition],
 								  DBUS_TYPE_INVALID);
 	if(message != NULL)
 	{
+		dbus_message_iter_init_append(message, &iter);
+		if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ssii)", &array) == (uint32_t)1)
+		{
+			for(index = 0; index < count; index++)
+			{
+				const char *name = g_signalModeManagerEventNames[signals[index].event];
+				const char *mode = signals[index].mode;
+				int32_t app = signals[index].app;
+				int32_t resources = signals[index].resources;
+				if(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1)
+				{
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &mode);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &app);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &resources);
+					(void)dbus_message_iter_close_container(&array, &entry);
+				}
+			}
+			(void)dbus_message_iter_close_container(&iter, &array);
+		}
 		if(SendDBusMessage(message, NULL) == 1)
 		{
-			TCLog(TCLogLevelDebug, "%s\n", __FUNCTION__);
+			TCLog(TCLogLevelDebug, "%s: %d signals\n", __FUNCTION__, count);
 		}
 		else
 		{
@@ -207,6 +331,86 @@ void SendDBusResumeMode(void)
 	}
 }
 
+/*
+ * unicast to the name bound to app and a copy to each observer, broadcast when app has
+ * no name bound. Nobody else on the bus sees another app's signals.
+ */
+static void DBusSendAppSignal(DBusMessage *message, int32_t app)
+{
+	gchar *name = NULL;
+	gchar **observers = NULL;
+	guint index = 0;
+	g_mutex_lock(&s_clientMutex);
+	if((s_appNames != NULL) && (s_observers != NULL))
+	{
+		name = g_strdup((const gchar *)g_hash_table_lookup(s_appNames, GINT_TO_POINTER(app)));
+		if((name != NULL) && (g_hash_table_size(s_observers) > 0U))
+		{
+			GHashTableIter iter;
+			gpointer key;
+			observers = g_new0(gchar *, g_hash_table_size(s_observers) + 1U);
+			g_hash_table_iter_init(&iter, s_observers);
+			while(g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+			{
+				observers[index] = g_strdup((const gchar *)key);
+				index++;
+			}
+		}
+	}
+	g_mutex_unlock(&s_clientMutex);
+	if(name != NULL)
+	{
+		/* copies first, a sent message is locked */
+		for(index = 0; (observers != NULL) && (observers[index] != NULL); index++)
+		{
+			if(g_strcmp0(observers[index], name) != 0)
+			{
+				DBusSendSignalCopy(message, observers[index]);
+			}
+		}
+		g_strfreev(observers);
+		if(dbus_message_set_destination(message, name) == (uint32_t)1)
+		{
+			if(SendDBusMessage(message, NULL) != 1)
+			{
+				TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+			}
+		}
+		else
+		{
+			TCLog(TCLogLevelError, "%s: dbus_message_set_destination failed\n", __FUNCTION__);
+		}
+		g_free(name);
+	}
+	else
+	{
+		if(SendDBusMessage(message, NULL) != 1)
+		{
+			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+		}
+	}
+}
+
+static void DBusSendSignalCopy(DBusMessage *message, const char *name)
+{
+	DBusMessage *copy = dbus_message_copy(message);
+	if(copy != NULL)
+	{
+		if(dbus_message_set_destination(copy, name) == (uint32_t)1)
+		{
+			if(SendDBusMessage(copy, NULL) != 1)
+			{
+				TCLog(TCLogLevelError, "%s: SendDBusMessage to %s failed\n", __FUNCTION__, name);
+			}
+		}
+		dbus_message_unref(copy);
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: dbus_message_copy failed\n", __FUNCTION__);
+	}
+}
+
 static DBusMsgErrorCode OnReceivedMethodCall(DBusMessage *message, const char *interface)
 {
 	DBusMsgErrorCode error = ErrorCodeNoError;
@@ -219,7 +423,9 @@ static DBusMsgErrorCode OnReceivedMethodCall(DBusMessage *message, const char *i
 		{
 			if(dbus_message_is_method_call(message, MODEMANAGER_EVENT_INTERFACE, g_methodModeManagerEventNames[index]) == (uint32_t)1)
 			{
+				uint64_t start = ModeStatsNow();
 				s_DBusMethodProcess[index](message);
+				ModeStatsRecord(s_DBusMethodStats[index], ModeStatsDispatch, ModeStatsNow() - start);
 				stop = 1;
 			}
 		}
@@ -227,36 +433,110 @@ static DBusMsgErrorCode OnReceivedMethodCall(DBusMessage *message, const char *i
 	return error;
 }
 
+static DBusMsgErrorCode OnReceivedSignal(DBusMessage *message, const char *interface)
+{
+	DBusMsgErrorCode error = ErrorCodeNoError;
+	if((interface != NULL) && (strcmp(interface, DBUS_INTERFACE_DBUS) == 0))
+	{
+		if(dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameOwnerChanged") == (uint32_t)1)
+		{
+			const char *name;
+			const char *oldOwner;
+			const char *newOwner;
+			if(GetArgumentFromDBusMessage(message,
+										  DBUS_TYPE_STRING, &name,
+										  DBUS_TYPE_STRING, &oldOwner,
+										  DBUS_TYPE_STRING, &newOwner,
+										  DBUS_TYPE_INVALID) != 0)
+			{
+				/* a unique name losing its owner is a client leaving the bus */
+				if((name[0] == ':') && (newOwner[0] == '\0'))
+				{
+					DBusClientGone(name);
+				}
+			}
+		}
+	}
+	return error;
+}
+
+/* s_clientMutex held, name registered app */
+static void DBusTrackClient(const char *name, int32_t app)
+{
+	GHashTable *apps = (GHashTable *)g_hash_table_lookup(s_clientApps, name);
+	if(apps == NULL)
+	{
+		apps = g_hash_table_new(g_direct_hash, g_direct_equal);
+		(void)g_hash_table_insert(s_clientApps, g_strdup(name), apps);
+	}
+	(void)g_hash_table_add(apps, GINT_TO_POINTER(app));
+	TCLog(TCLogLevelDebug, "%s : %s is app %d\n", __FUNCTION__, name, app);
+}
+
+static void DBusClientGone(const char *name)
+{
+	GHashTable *apps = NULL;
+	GHashTableIter iter;
+	gpointer key;
+	g_mutex_lock(&s_clientMutex);
+	if((s_clientApps != NULL) && (s_appNames != NULL) && (s_observers != NULL))
+	{
+		if(g_hash_table_steal_extended(s_clientApps, name, &key, (gpointer *)&apps) == TRUE)
+		{
+			g_free(key);
+			/* an app registered again under another name since stays with that one */
+			g_hash_table_iter_init(&iter, apps);
+			while(g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+			{
+				if(g_strcmp0((const gchar *)g_hash_table_lookup(s_appNames, key), name) != 0)
+				{
+					g_hash_table_iter_remove(&iter);
+				}
+			}
+		}
+		(void)g_hash_table_foreach_remove(s_appNames, DBusAppNameIs, (gpointer)name);
+		(void)g_hash_table_remove(s_observers, name);
+	}
+	g_mutex_unlock(&s_clientMutex);
+	if(apps != NULL)
+	{
+		g_hash_table_iter_init(&iter, apps);
+		while(g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+		{
+			TCLog(TCLogLevelWarn, "%s : %s (app %d) left the bus, reclaiming its resources\n", __FUNCTION__,
+				  name, GPOINTER_TO_INT(key));
+			shutdownMode(GPOINTER_TO_INT(key));
+		}
+		g_hash_table_destroy(apps);
+	}
+}
+
+static gboolean DBusAppNameIs(gpointer key, gpointer value, gpointer user_data)
+{
+	(void)key;
+	return (g_strcmp0((const gchar *)value, (const gchar *)user_data) == 0) ? TRUE : FALSE;
+}
+
 static void DBusMethodChangeMode(DBusMessage * message)
 {
 	if(message != NULL)
 	{
-		DBusMessage *returnMessage;
 		const char* mode;
 		int32_t app;
-		int32_t retVal = 0;
+		/* the reply is sent from DBusReplyChangeMode once the change is committed */
+		(void)dbus_message_ref(message);
 		if(GetArgumentFromDBusMessage(message,
 									  DBUS_TYPE_STRING, &mode,
 									  DBUS_TYPE_INT32, &app,
 									  DBUS_TYPE_INVALID) != 0)
 		{
 			TCLog(TCLogLevelDebug, "%s mode : %s, from : %d\n", __FUNCTION__, mode, app);
-			retVal = cmpModePriority(mode, app);
+			cmpModePriorityAsync(mode, app, DBusReplyChangeMode, message);
 		}
 		else
 		{
 			TCLog(TCLogLevelError, "%s: GetArgumentFromDBusMessage failed\n", __FUNCTION__);
-		}
-		returnMessage = CreateDBusMsgMethodReturn(message,
-												  DBUS_TYPE_INT32, &retVal,
-												  DBUS_TYPE_INVALID);
-		if(returnMessage != NULL)
-		{
-			if(SendDBusMessage(returnMessage, NULL) != 1)
-			{
-				TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
-			}
-			dbus_message_unref(returnMessage);
+			DBusReplyChangeMode(0, "", -1, NULL, 0, message);
 		}
 	}
 	else
@@ -265,6 +545,49 @@ static void DBusMethodChangeMode(DBusMessage * message)
 	}
 }
 
+static void DBusReplyChangeMode(int32_t result, const char *mode, int32_t app,
+								const ReleaseApp *released, int32_t count, void *user)
+{
+	DBusMessage *message = (DBusMessage *)user;
+	DBusMessage *returnMessage;
+	const char *dbusMode = mode;
+	int32_t retVal = result;
+	(void)app;
+
+	/* reply : result, resulting mode, array of (app, resources) asked to be released */
+	returnMessage = CreateDBusMsgMethodReturn(message,
+											  DBUS_TYPE_INT32, &retVal,
+											  DBUS_TYPE_STRING, &dbusMode,
+											  DBUS_TYPE_INVALID);
+	if(returnMessage != NULL)
+	{
+		DBusMessageIter iter;
+		DBusMessageIter array;
+		DBusMessageIter entry;
+		int32_t index;
+		dbus_message_iter_init_append(returnMessage, &iter);
+		if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ii)", &array) == (uint32_t)1)
+		{
+			for(index = 0; index < count; index++)
+			{
+				if(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1)
+				{
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &released[index].app);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &released[index].resource);
+					(void)dbus_message_iter_close_container(&array, &entry);
+				}
+			}
+			(void)dbus_message_iter_close_container(&iter, &array);
+		}
+		if(SendDBusMessage(returnMessage, NULL) != 1)
+		{
+			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+		}
+		dbus_message_unref(returnMessage);
+	}
+	dbus_message_unref(message);
+}
+
 static void DBusMethodEndMode(DBusMessage * message)
 {
 	if(message != NULL)
@@ -330,3 +653,376 @@ static void DBusMethodResume(DBusMessage * message)
 	(void)message;
 	systemResumeMode();
 }
+static void DBusMethodGetStats(DBusMessage * message)
+{
+	TCLog(TCLogLevelDebug, "%s \n", __FUNCTION__);
+	if(message != NULL)
+	{
+		DBusMessage *returnMessage;
+		/*
+		 * reply : a(ssttttt) method, stage, count, p50, p90, p99, max in nsec, a{st} counters,
+		 * a(iuu) app, change_mode superseded, change_mode merged
+		 */
+		returnMessage = CreateDBusMsgMethodReturn(message, DBUS_TYPE_INVALID);
+		if(returnMessage != NULL)
+		{
+			DBusMessageIter iter;
+			DBusMessageIter array;
+			DBusMessageIter entry;
+			int32_t method;
+			int32_t stage;
+			ModeStatsSummary summary;
+			ModeManagerStats stats;
+			dbus_message_iter_init_append(returnMessage, &iter);
+			if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ssttttt)", &array) == (uint32_t)1)
+			{
+				for(method = 0; method < (int32_t)TotalModeStatsMethod; method++)
+				{
+					for(stage = 0; stage < (int32_t)TotalModeStatsStage; stage++)
+					{
+						ModeStatsSummarize(method, stage, &summary);
+						if((summary.count != 0U) &&
+						   (dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1))
+						{
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &g_modeStatsMethodNames[method]);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &g_modeStatsStageNames[stage]);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &summary.count);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &summary.p50);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &summary.p90);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &summary.p99);
+							(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &summary.max);
+							(void)dbus_message_iter_close_container(&array, &entry);
+						}
+					}
+				}
+				(void)dbus_message_iter_close_container(&iter, &array);
+			}
+			getModeManagerStats(&stats);
+			if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{st}", &array) == (uint32_t)1)
+			{
+				DBusAppendCounter(&array, "wakeups", stats.wakeups);
+				DBusAppendCounter(&array, "wakeups_per_sec", stats.wakeupsPerSec);
+				DBusAppendCounter(&array, "queue_depth", stats.queueDepth);
+				DBusAppendCounter(&array, "queue_high_water", stats.queueHighWater);
+				DBusAppendCounter(&array, "queue_dropped", stats.queueDropped);
+				DBusAppendCounter(&array, "release_timeouts", stats.releaseTimeouts);
+				DBusAppendCounter(&array, "decision_hits", stats.decisionHits);
+				DBusAppendCounter(&array, "decision_misses", stats.decisionMisses);
+				DBusAppendCounter(&array, "decision_mismatches", stats.decisionMismatches);
+				DBusAppendCounter(&array, "decision_states", stats.decisionStates);
+				DBusAppendCounter(&array, "signals_sent", stats.signalsSent);
+				DBusAppendCounter(&array, "signals_coalesced", stats.signalsCoalesced);
+				DBusAppendCounter(&array, "requests_superseded", stats.requestsSuperseded);
+				DBusAppendCounter(&array, "requests_merged", stats.requestsMerged);
+				(void)dbus_message_iter_close_container(&iter, &array);
+			}
+			if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(iuu)", &array) == (uint32_t)1)
+			{
+				ModeAppCoalesce counters[DBUS_STATS_APPS_MAX];
+				int32_t count = getModeCoalescedRequests(counters, DBUS_STATS_APPS_MAX);
+				int32_t index;
+				for(index = 0; index < count; index++)
+				{
+					if(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1)
+					{
+						(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &counters[index].app);
+						(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &counters[index].superseded);
+						(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &counters[index].merged);
+						(void)dbus_message_iter_close_container(&array, &entry);
+					}
+				}
+				(void)dbus_message_iter_close_container(&iter, &array);
+			}
+			if(SendDBusMessage(returnMessage, NULL) != 1)
+			{
+				TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+			}
+			dbus_message_unref(returnMessage);
+		}
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+static void DBusMethodDumpTrace(DBusMessage * message)
+{
+	TCLog(TCLogLevelDebug, "%s \n", __FUNCTION__);
+	if(message != NULL)
+	{
+		DBusMessage *returnMessage;
+		int32_t result = ModeTraceDump(MODE_TRACE_FILE);
+		const char *path = MODE_TRACE_FILE;
+		/* reply : result (0 on success), dump file */
+		returnMessage = CreateDBusMsgMethodReturn(message,
+												  DBUS_TYPE_INT32, &result,
+												  DBUS_TYPE_STRING, &path,
+												  DBUS_TYPE_INVALID);
+		if(returnMessage != NULL)
+		{
+			if(SendDBusMessage(returnMessage, NULL) != 1)
+			{
+				TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+			}
+			dbus_message_unref(returnMessage);
+		}
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+static void DBusMethodReloadPolicy(DBusMessage * message)
+{
+	TCLog(TCLogLevelDebug, "%s \n", __FUNCTION__);
+	if(message != NULL)
+	{
+		/* parsed on the main loop, with inline arbitration this thread arbitrates */
+		(void)g_idle_add(DBusReloadPolicy, dbus_message_ref(message));
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+
+static gboolean DBusReloadPolicy(gpointer user_data)
+{
+	DBusMessage *message = (DBusMessage *)user_data;
+	DBusMessage *returnMessage;
+	int32_t result = reloadModePolicy();
+	/* reply : result (0 when the new policy is in use) */
+	returnMessage = CreateDBusMsgMethodReturn(message,
+											  DBUS_TYPE_INT32, &result,
+											  DBUS_TYPE_INVALID);
+	if(returnMessage != NULL)
+	{
+		if(SendDBusMessage(returnMessage, NULL) != 1)
+		{
+			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+		}
+		dbus_message_unref(returnMessage);
+	}
+	dbus_message_unref(message);
+	return FALSE;
+}
+
+static void DBusAppendCounter(DBusMessageIter *array, const char *name, uint64_t value)
+{
+	DBusMessageIter entry;
+	if(dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL, &entry) == (uint32_t)1)
+	{
+		(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+		(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &value);
+		(void)dbus_message_iter_close_container(array, &entry);
+	}
+}
+
+/*
+ * register_app(int32 app) : binds app to the caller's unique name. Its signals then go to
+ * that name only, and its resources are reclaimed when the name leaves the bus. Crash
+ * recovery covers registered apps only, see s_clientApps.
+ */
+static void DBusMethodRegisterApp(DBusMessage * message)
+{
+	TCLog(TCLogLevelDebug, "%s \n", __FUNCTION__);
+	if(message != NULL)
+	{
+		DBusMessage *returnMessage;
+		const char *sender = dbus_message_get_sender(message);
+		gchar *owner = NULL;
+		int32_t app = -1;
+		int32_t result = -1;
+		if((sender != NULL) &&
+		   (GetArgumentFromDBusMessage(message,
+									   DBUS_TYPE_INT32, &app,
+									   DBUS_TYPE_INVALID) != 0))
+		{
+			g_mutex_lock(&s_clientMutex);
+			if((s_clientApps != NULL) && (s_appNames != NULL) && (s_observers != NULL))
+			{
+				if(app == MODE_APP_OBSERVER)
+				{
+					(void)g_hash_table_insert(s_observers, g_strdup(sender), NULL);
+					result = 0;
+				}
+				else if(app >= 0)
+				{
+					/*
+					 * An app id stays with the name that registered it until that name leaves
+					 * the bus and DBusClientGone() unbinds it, a restarted app gets it back
+					 * then. Another client can not take it over, nor its signals.
+					 */
+					const gchar *bound = (const gchar *)g_hash_table_lookup(s_appNames, GINT_TO_POINTER(app));
+					if((bound == NULL) || (g_strcmp0(bound, sender) == 0))
+					{
+						(void)g_hash_table_insert(s_appNames, GINT_TO_POINTER(app), g_strdup(sender));
+						DBusTrackClient(sender, app);
+						result = 0;
+					}
+					else
+					{
+						owner = g_strdup(bound);
+					}
+				}
+				else
+				{
+					/* not an app id */
+				}
+			}
+			g_mutex_unlock(&s_clientMutex);
+			TCLog(TCLogLevelInfo, "%s : %s as app %d, %d\n", __FUNCTION__, sender, app, result);
+		}
+		else
+		{
+			TCLog(TCLogLevelError, "%s: GetArgumentFromDBusMessage failed\n", __FUNCTION__);
+		}
+		/* reply : result, 0 once signals for app are sent to the caller only */
+		if(owner != NULL)
+		{
+			gchar *text = g_strdup_printf("app %d is bound to %s", app, owner);
+			TCLog(TCLogLevelWarn, "%s : %s refused, %s\n", __FUNCTION__, sender, text);
+			returnMessage = dbus_message_new_error(message, MODE_ERROR_APP_BOUND, text);
+			g_free(text);
+			g_free(owner);
+		}
+		else
+		{
+			returnMessage = CreateDBusMsgMethodReturn(message,
+													  DBUS_TYPE_INT32, &result,
+													  DBUS_TYPE_INVALID);
+		}
+		if(returnMessage != NULL)
+		{
+			if(SendDBusMessage(returnMessage, NULL) != 1)
+			{
+				TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+			}
+			dbus_message_unref(returnMessage);
+		}
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+
+static void DBusMethodChangeModes(DBusMessage * message)
+{
+	if(message != NULL)
+	{
+		DBusChangeModes *batch = g_new0(DBusChangeModes, 1);
+		DBusMessageIter iter;
+		DBusMessageIter array;
+		DBusMessageIter entry;
+		int32_t refused = 0;
+		/* the reply is sent from DBusReplyChangeModes once the whole batch is committed */
+		batch->message = dbus_message_ref(message);
+		if((dbus_message_iter_init(message, &iter) == (uint32_t)1) &&
+		   (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY))
+		{
+			dbus_message_iter_recurse(&iter, &array);
+			while(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT)
+			{
+				if(batch->count < CHANGE_MODES_MAX)
+				{
+					ModeBatchItem *item = &batch->items[batch->count];
+					item->mode = "";
+					item->app = -1;
+					item->op = -1;
+					dbus_message_iter_recurse(&array, &entry);
+					if(dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_STRING)
+					{
+						dbus_message_iter_get_basic(&entry, &item->mode);
+						(void)dbus_message_iter_next(&entry);
+					}
+					if(dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_INT32)
+					{
+						dbus_message_iter_get_basic(&entry, &item->app);
+						(void)dbus_message_iter_next(&entry);
+					}
+					if(dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_INT32)
+					{
+						dbus_message_iter_get_basic(&entry, &item->op);
+					}
+					batch->count++;
+				}
+				else
+				{
+					refused++;
+				}
+				(void)dbus_message_iter_next(&array);
+			}
+		}
+		if(refused > 0)
+		{
+			TCLog(TCLogLevelWarn, "%s : %d calls past %d refused\n", __FUNCTION__, refused, CHANGE_MODES_MAX);
+		}
+		TCLog(TCLogLevelDebug, "%s : %d calls\n", __FUNCTION__, batch->count);
+		changeModesAsync(batch->items, batch->count, DBusReplyChangeModes, batch);
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s: message is NULL\n", __FUNCTION__);
+	}
+}
+
+static void DBusReplyChangeModes(int32_t result, const char *mode, int32_t app,
+								 const ReleaseApp *released, int32_t count, void *user)
+{
+	DBusChangeModes *batch = (DBusChangeModes *)user;
+	DBusMessage *returnMessage;
+	int32_t retVal = result;
+	(void)mode;
+	(void)app;
+
+	/*
+	 * reply : changes made, array of (result, resulting mode) in the order of the calls,
+	 * array of (app, resources) asked to be released
+	 */
+	returnMessage = CreateDBusMsgMethodReturn(batch->message,
+											  DBUS_TYPE_INT32, &retVal,
+											  DBUS_TYPE_INVALID);
+	if(returnMessage != NULL)
+	{
+		DBusMessageIter iter;
+		DBusMessageIter array;
+		DBusMessageIter entry;
+		int32_t index;
+		dbus_message_iter_init_append(returnMessage, &iter);
+		if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(is)", &array) == (uint32_t)1)
+		{
+			for(index = 0; index < batch->count; index++)
+			{
+				const char *changed = batch->items[index].changed;
+				if(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1)
+				{
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &batch->items[index].result);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &changed);
+					(void)dbus_message_iter_close_container(&array, &entry);
+				}
+			}
+			(void)dbus_message_iter_close_container(&iter, &array);
+		}
+		if(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ii)", &array) == (uint32_t)1)
+		{
+			for(index = 0; index < count; index++)
+			{
+				if(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry) == (uint32_t)1)
+				{
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &released[index].app);
+					(void)dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &released[index].resource);
+					(void)dbus_message_iter_close_container(&array, &entry);
+				}
+			}
+			(void)dbus_message_iter_close_container(&iter, &array);
+		}
+		if(SendDBusMessage(returnMessage, NULL) != 1)
+		{
+			TCLog(TCLogLevelError, "%s: SendDBusMessage failed\n", __FUNCTION__);
+		}
+		dbus_message_unref(returnMessage);
+	}
+	dbus_message_unref(batch->message);
+	g_free(batch);
+}
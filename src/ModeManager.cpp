@@ -28,14 +28,22 @@ between Telechips and Company.
 #include <iostream>
 #include <cstring>
 #include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <map>
 #include <algorithm>
 #include <iterator>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "TCLog.h"
 #include "ModeManager.h"
+#include "ModeStats.h"
+#include "ModeTrace.h"
+#include "ModeStatePage.h"
 
 #define RELEASENONE 		0x0000
 #define RELEASEDISPLAY		0x0001
@@ -46,37 +54,212 @@ between Telechips and Company.
 #define DEFAULTAPP			0
 #define OSDAPP				100
 
+#define CMDQUEUE_MAX		64
+
+#define MODE_NONE			(-1)
+
+#define MODE_REQ_CHANGE		0
+#define MODE_REQ_END		1
+#define MODE_REQ_RELEASED	2
+#define MODE_REQ_SUSPEND	3
+#define MODE_REQ_RESUME		4
+#define MODE_REQ_TIMER		5
+#define MODE_REQ_SHUTDOWN	6
+#define MODE_REQ_RELOAD		7
+#define MODE_REQ_BATCH		8
+
+#define TIMERWHEEL_SLOTS	512
+#define TIMERWHEEL_TICK		10		/* msec */
+
+#define KIND_DISPLAY		0		/* ResourceKind index, the built-in kinds first */
+#define KIND_AUDIO			1
+#define KIND_TUNER			2
+#define KIND_BUILTIN		3
+#define RESOURCE_KINDS		MODE_RESOURCE_KINDS_MAX
+#define RESOURCE_LEVEL_MAX	255		/* levels are kept a byte each */
+
+#define DECISION_OPS		8		/* release list changes one cached decision replays */
+#define DECISION_STATES		1024	/* stack states interned before the cache starts over */
+
 typedef struct
 {
-	std::string mode;
+	int32_t mode;		/* interned mode id */
 	int32_t app;
-	int32_t audio;
-	int32_t display;
-	int32_t tuner;
+	uint8_t level[RESOURCE_KINDS];	/* priority per ResourceKind, 0 if not used */
 	int32_t full;
 	int32_t resume;
 	int32_t mixing;
 	int32_t exclusive;
-	int32_t state;
+	int32_t background;	/* _policy index of "<mode>bg" for the same app, -1 if none */
+	int32_t foreground;	/* _policy index of the mode this "bg" variant belongs to, -1 if none */
+} Policy;
+
+/* a resource modes compete for, display, audio and tuner then the ones the policy declares */
+typedef struct
+{
+	std::string name;
+	int32_t mask;		/* RELEASExxx bit of release_resource */
+	int32_t timeout;	/* release deadline in msec, 0 waits forever */
+} ResourceKind;
+
+/*
+ * Everything taken from the policy file. A table is filled once and only read after it
+ * is published. Mode ids stay valid across reloads, a new table starts from the names of
+ * the one in use and only appends to them, and so do resource kinds.
+ */
+typedef struct
+{
+	std::vector<Policy> policy;
+	std::vector<std::string> names;					/* mode id -> mode name */
+	std::unordered_map<std::string, int32_t> ids;		/* mode name -> mode id */
+	std::unordered_map<uint64_t, uint32_t> index;		/* (mode id, app) -> policy index */
+	ResourceKind kinds[RESOURCE_KINDS];
+	uint32_t kindCount;
+} PolicyTable;
+
+typedef struct
+{
+	int32_t mode;		/* interned mode id, MODE_NONE if no mode */
+	int32_t app;
+	int32_t policy;		/* _policy index, -1 if no mode */
+	uint8_t level[RESOURCE_KINDS];	/* a byte per kind keeps the record at 28 bytes */
+	int32_t exclusive;
+	uint8_t full;
+	uint8_t resume;
+	uint8_t mixing;
+	uint8_t state;
 } Resource;
 
+
+/* an AddReleaseResources() or RemoveReleaseResources() call made while deciding */
+typedef struct
+{
+	int32_t app;
+	int32_t resource;
+	int32_t remove;
+} DecisionOp;
+
+/*
+ * What ModeDecide() made of a change_mode : the outcome, the mode to run (the bg variant
+ * if the display was refused) and the release list changes it made on the way, which a
+ * cache hit replays. opCount past DECISION_OPS marks a decision too long to cache.
+ */
+typedef struct
+{
+	int32_t result;
+	Resource compare;
+	uint32_t opCount;
+	DecisionOp ops[DECISION_OPS];
+} ModeDecision;
+
+typedef std::unordered_map<uint64_t, ModeDecision> DecisionMap;	/* (mode id, app) -> decision */
+
+/* a caller whose change_mode joined the same one still queued */
+typedef struct ModeReplyTo
+{
+	ChangeModeReply_cb done;
+	void *user;
+	struct ModeReplyTo *next;
+} ModeReplyTo;
+
+typedef struct
+{
+	int32_t type;					/* MODE_REQ_xxx */
+	char mode[sizeof(((Mode *)NULL)->mode)];
+	int32_t app;
+	int32_t resources;
+	ChangeModeReply_cb done;		/* called on the manager thread once the request ran */
+	void *user;
+	uint64_t posted;				/* ModeStatsNow() when queued */
+	ModeReplyTo *merged;			/* answered as done, in the order they came */
+} ModeRequest;
+
+typedef struct
+{
+	bool done;
+	int32_t result;
+} ModeWaiter;
+
+/*
+ * user of a MODE_REQ_BATCH. The items are arbitrated in a row within the one request, reply
+ * gets the number of changes made. An async batch is freed once replied.
+ */
+typedef struct
+{
+	ModeBatchItem *items;
+	int32_t count;
+	ChangeModeReply_cb reply;
+	void *user;
+	bool owned;
+} ModeBatch;
+
+/* a signal raised while a request runs, held until ModeSignalFlush() */
 typedef struct
 {
+	int32_t event;					/* MODE_SIGNAL_xxx */
+	const char *mode;				/* policy or request string, both outlive the flush */
 	int32_t app;
+	int32_t resources;
+	bool dropped;					/* superseded, not sent */
+} PendingSignal;
+
+/* user of a MODE_REQ_RELOAD, the manager thread swaps table with the one it replaces */
+typedef struct
+{
+	PolicyTable *table;
+	bool swapped;
+	ModeWaiter waiter;
+} ModeReload;
+
+typedef struct
+{
+	int32_t app;
+	int32_t resource;		/* one RELEASExxx bit */
+	uint64_t deadline;		/* wheel tick */
+} ReleaseTimer;
+
+typedef struct
+{
+	const char *name;
 	int32_t resource;
-} ReleaseApp;
+} BuiltinKind;
+
+/*
+ * Arbitration of the kinds past audio and display, which keep rules of their own. The
+ * loops are instantiated for N kinds fixed at compile time and for N = 0, which takes
+ * the count from the policy. _kinds points at the KIND_BUILTIN instance as long as the
+ * policy declares no kinds of its own.
+ */
+typedef struct
+{
+	bool (*compare)(const Resource *mode);
+	void (*take)(const Resource *mode);
+	void (*state)(void);
+} ModeKindOps;
 
-bool operator==(Resource a, Resource b)
+bool operator==(const Resource &a, const Resource &b)
 {
 	bool ret;
-	ret = (a.mode.compare(b.mode) == 0) && (a.app == b.app);
+	ret = (a.mode == b.mode) && (a.app == b.app);
 	return ret;
 }
 
-std::vector<Mode> _policy;
-std::vector<Resource> _audio;
-std::vector<Resource> _display;
-std::vector<Resource> _tuner;
+/*
+ * The policy in use, read by the manager thread only. setModePolicy() fills _buildTable,
+ * which ModeManagerInitiallize() publishes at start and reloadModePolicy() hands to the
+ * manager thread to swap in between two requests. _reloadMutex keeps one table in the
+ * making at a time.
+ */
+static PolicyTable _emptyTable;
+static PolicyTable *_policyTable = &_emptyTable;
+static PolicyTable *_buildTable = NULL;
+static pthread_mutex_t _reloadMutex = PTHREAD_MUTEX_INITIALIZER;
+static ModePolicyLoad_cb _PolicyLoad = NULL;
+/* one priority stack per ResourceKind, the built-in ones also go by their own names */
+static std::vector<Resource> _stacks[RESOURCE_KINDS];
+static std::vector<Resource> &_audio = _stacks[KIND_AUDIO];
+static std::vector<Resource> &_display = _stacks[KIND_DISPLAY];
+static std::vector<Resource> &_tuner = _stacks[KIND_TUNER];
 std::vector<ReleaseApp> _relAppList;
 
 static ChangedMode_cb		_ChangedMode = NULL;
@@ -85,36 +268,247 @@ static EndedMode_cb			_EndedMode = NULL;
 static SuspendMode_cb		_SuspendMode = NULL;
 static ResumeMode_cb		_ResumeMode = NULL;
 
+/* host callbacks behind _ChangedMode, _ReleaseResource, _EndedMode, _SuspendMode and _ResumeMode */
+static ChangedMode_cb		_HostChangedMode = NULL;
+static ReleaseResource_cb	_HostReleaseResource = NULL;
+static EndedMode_cb			_HostEndedMode = NULL;
+static SuspendMode_cb		_HostSuspendMode = NULL;
+static ResumeMode_cb		_HostResumeMode = NULL;
+static Transition_cb		_HostTransition = NULL;
+
+/*
+ * Signals raised by one request, owned like the resource state. Unless MODE_SIGNAL_DIRECT,
+ * they are held here and ModeSignalFlush() sends what is left of them once the request
+ * ran, before its reply. Off by default, a batched request drops the signals it superseded
+ * and clients that count every changed_mode would see fewer.
+ */
+static int32_t _signalBatch = MODE_SIGNAL_DIRECT;
+static std::vector<PendingSignal> _signalPending;
+static std::vector<ModeSignal> _signalTransition;
+static uint64_t _signalsSent = 0;
+static uint64_t _signalsCoalesced = 0;
+
+/* stack depths at the last traced event, owned like the resource state */
+static uint8_t _traceAudio = 0;
+static uint8_t _traceDisplay = 0;
+static uint8_t _traceTuner = 0;
+static uint8_t _traceRelease = 0;
+
+/*
+ * Resource state (_audio, _display, _tuner, _relAppList and _cmdMode) is owned by the
+ * manager thread. Other threads only queue ModeRequests and, for change_mode, wait on
+ * _doneCond for the outcome.
+ * With inline arbitration there is no manager thread, requests run on the calling
+ * thread and _inlineMutex keeps them from overlapping.
+ */
+static bool _inlineArbitration = false;
+static pthread_mutex_t _inlineMutex = PTHREAD_MUTEX_INITIALIZER;
 Resource _cmdMode;
+static std::deque<ModeRequest> _cmdQueue;
 static pthread_mutex_t _cmdMutex;
 static pthread_mutex_t *_cmdMutexPtr = NULL;
+static pthread_cond_t _cmdCond;
+static pthread_cond_t *_cmdCondPtr = NULL;
+static pthread_cond_t _doneCond;
+static pthread_cond_t *_doneCondPtr = NULL;
 static bool _modemanagerStatus = false;
 pthread_t _modemanagerThread;
 
+/* wakeup accounting of the manager thread, protected by _cmdMutex */
+static uint64_t _wakeupTotal = 0;
+static uint32_t _wakeupCount = 0;
+static uint32_t _wakeupLastCount = 0;
+static time_t _wakeupSecond = 0;
+
+/* command queue accounting, protected by _cmdMutex */
+static uint32_t _cmdHighWater = 0;
+static uint64_t _cmdDropped = 0;
+
+/* the kinds every policy starts with, in KIND_xxx order */
+static const BuiltinKind _builtinKinds[KIND_BUILTIN] =
+{
+	{ "display",	RELEASEDISPLAY },
+	{ "audio",		RELEASEAUDIO },
+	{ "tuner",		RELEASETUNER },
+};
+
+/*
+ * release_resource deadlines, the timeouts come with the resource kinds of the policy
+ * table. A timer is armed per resource when release_resource is sent and kept in a hashed
+ * timer wheel owned like the resource state. Timers are not cancelled by
+ * release_resource_done, an expired one whose resource is no longer in _relAppList was
+ * answered in time and is dropped.
+ */
+static std::vector<ReleaseTimer> _timerWheel[TIMERWHEEL_SLOTS];
+static std::vector<ReleaseTimer> _timerExpired;
+static uint32_t _timerCount = 0;
+static uint64_t _timerTick = 0;		/* tick the wheel was last advanced to */
+static uint64_t _timerArmed = 0;	/* tick the host timer is armed for with inline arbitration, 0 if none */
+static ModeTimer_cb _ModeTimer = NULL;
+
+/*
+ * Coalescing of the command queue, protected by _cmdMutex, off unless the host asks for
+ * it : a superseded caller is answered MODE_CHANGE_SUPERSEDED, which a client checking
+ * result != 0 takes for a change. A change_mode that finds the last queued request of its
+ * app to be a change_mode joins it for the same mode and takes its place for a mode that
+ * holds every resource the queued one would have.
+ */
+static bool _coalesce = false;
+static std::map<int32_t, ModeAppCoalesce> _coalesced;
+static uint64_t _supersededTotal = 0;
+static uint64_t _mergedTotal = 0;
+
+/* forced releases, protected by _cmdMutex */
+static std::map<int32_t, uint32_t> _releaseTimeouts;
+static uint64_t _releaseTimeoutTotal = 0;
+
+/*
+ * change_mode decisions per stack state, owned like the resource state. A state is the
+ * part of the stacks ModeDecide() reads, interned to an id in _decisionStateIds so equal
+ * stacks share their decisions. Whatever changes the stacks sets _decisionDirty and the
+ * state is interned again by the next change_mode. Off unless the host asks for it, a
+ * missed invalidation would answer from stacks that are gone.
+ */
+static int32_t _decisionCache = MODE_DECISION_OFF;
+static std::unordered_map<std::string, uint32_t> _decisionStateIds;
+static std::vector<DecisionMap> _decisionTables;
+static std::string _decisionKey;
+static uint32_t _decisionState = 0;
+static bool _decisionDirty = true;
+static bool _publishHeld = false;		/* a batch runs, the state page shows its outcome only */
+static ModeDecision *_decisionRecord = NULL;	/* ModeDecide() in progress */
+static uint64_t _decisionHits = 0;
+static uint64_t _decisionMisses = 0;
+static uint64_t _decisionMismatches = 0;
+static uint32_t _decisionStateCount = 0;
+
+/* MODE_REQ_xxx -> ModeStatsMethod, -1 for internal requests */
+static const int32_t _statsMethod[] =
+{
+	ModeStatsChangeMode,
+	ModeStatsEndMode,
+	ModeStatsReleaseResourceDone,
+	ModeStatsSuspend,
+	ModeStatsResume,
+	-1,
+	-1,
+	-1,
+	ModeStatsChangeModes,
+};
+
 static void ModeAllResourcePrint();
 static void ModeResume();
 static void ModeShutdown();
 static void ModeClearcmd();
+static void ModeRunCommand();
+static bool ModePostRequest(int32_t type, const char* mode, int32_t app, int32_t resources,
+							ChangeModeReply_cb done, void *user);
+static int32_t ModeCoalesceRequest(const ModeRequest *request, ModeRequest *superseded);
+static bool ModeCoalesceCovers(const char *older, const char *newer, int32_t app);
+static void ModeReplyMerged(const ModeRequest *request, int32_t result, const char *mode, int32_t app,
+							const ReleaseApp *released, int32_t count);
+static void ModeWaiterDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user);
+static void ModeResultDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user);
+static void ModeProcessRequest(const ModeRequest *request);
+static int32_t ModeProcessChange(const char* mode, int32_t app, Resource *changed);
+static void ModeDecide(const char* mode, int32_t modeId, int32_t app, ModeDecision *decision);
+static uint32_t ModeDecisionState();
+static void ModeDecisionAppend(const Resource *resource);
+static void ModeDecisionFlush();
+static bool ModeDecisionEqual(const ModeDecision *a, const ModeDecision *b);
+static void ModeProcessEnd(const char* mode, int32_t app);
+static void ModeProcessReleaseDone(int32_t resources, int32_t app);
+static void ModeProcessSuspend();
+static void ModeProcessShutdown(int32_t app);
+static int32_t ModeProcessReload(ModeReload *reload);
+static int32_t ModeProcessBatch(ModeBatch *batch);
+static void ModeBatchDone(int32_t result, const char *mode, int32_t app,
+						  const ReleaseApp *released, int32_t count, void *user);
+static bool ModeResolveResource(Resource *resource);
+static void ModeReloadDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user);
+static void ModeCountWakeup();
+static time_t ModeMonotonicSecond();
+static uint64_t ModeMonotonicTick();
+static void ModeTimerAdd(int32_t app, int32_t resources);
+static void ModeTimerExpire();
+static void ModeTimerClear();
+static int32_t ModeTimerNext();
+static void ModeTimerArm();
+static void ModeReleaseTimeout(int32_t app, int32_t resource);
+static void ModeRecordTrace(int32_t event, int32_t mode, int32_t app, int32_t arg, uint64_t time);
+static uint8_t ModeTraceDepth(size_t depth);
+static void ModeSignalChangedMode(const char *mode, int32_t app);
+static void ModeSignalReleaseResource(int32_t resources, int32_t app);
+static void ModeSignalEndedMode(const char *mode, int32_t app);
+static void ModeSignalSuspendMode(void);
+static void ModeSignalResumeMode(void);
+static void ModeSignalPost(int32_t event, const char *mode, int32_t app, int32_t resources);
+static void ModeSignalSend(int32_t event, const char *mode, int32_t app, int32_t resources);
+static void ModeSignalCoalesce();
+static void ModeSignalFlush();
 static void *ModeManagerThread(void *arg);
 static bool ModeCompareAudio(Resource mode);
 static bool ModeCompareDisplay(Resource mode);
-static bool ModeCompareTuner(Resource mode);
+static bool ModeCompareKind(uint32_t kind, const Resource *mode);
+template <uint32_t N> static uint32_t ModeKindCount();
+template <uint32_t N> static bool ModeCompareKinds(const Resource *mode);
+template <uint32_t N> static void ModeTakeKinds(const Resource *mode);
+template <uint32_t N> static void ModeKindsState();
+static void ModePublishKinds();
+static void ModePublishState();
 static bool ModeExclusiveCheck(Resource mode);
 static void ModeManagerResources();
 static void ModeChangeBackGround(void);
 static void ModeRestoreBackGround(void);
 static void ModeSendReleaseResource();
-static Resource ModeFindwithinPolicy(const char* mode, int32_t app);
+static Resource ModeFindwithinPolicy(int32_t mode, int32_t app);
+static int32_t ModeFindPolicy(int32_t mode, int32_t app);
+static Resource ModePolicyResource(int32_t policy);
+static Resource ModeNoneResource();
+static int32_t ModePolicyBackground(int32_t policy);
+static int32_t ModePolicyForeground(int32_t policy);
+static PolicyTable *ModeBuildTable();
+static void ModeLinkBackGround(PolicyTable *table, int32_t policy);
+static int32_t ModeInternName(PolicyTable *table, const char* mode);
+static int32_t ModeTableFindName(const PolicyTable *table, const char* mode);
+static int32_t ModeTableFindPolicy(const PolicyTable *table, int32_t mode, int32_t app);
+static int32_t ModeTableFindKind(const PolicyTable *table, const char* resource);
+static int32_t ModeDeclareKind(PolicyTable *table, const char* resource, int32_t mask);
+static uint8_t ModePolicyLevel(const Mode *policy, const char* resource, int32_t level);
+static int32_t ModeFindName(const char* mode);
+static const char *ModeName(int32_t mode);
+static uint64_t ModePolicyKey(int32_t id, int32_t app);
 static void AddReleaseResources(int32_t app, int32_t resource);
 static void RemoveReleaseResources(int32_t app, int32_t resource);
 
 
+static const ModeKindOps _kindOps[2] =
+{
+	{ ModeCompareKinds<KIND_BUILTIN>, ModeTakeKinds<KIND_BUILTIN>, ModeKindsState<KIND_BUILTIN> },
+	{ ModeCompareKinds<0>, ModeTakeKinds<0>, ModeKindsState<0> },
+};
+static const ModeKindOps *_kinds = &_kindOps[1];
+
 int32_t ModeManagerInitiallize()
 {
 	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
 	int32_t err = 0;
 	int32_t ret = 0;
 
+	/* the policy parsed so far goes live, nobody reads it yet */
+	pthread_mutex_lock(&_reloadMutex);
+	if(_buildTable != NULL)
+	{
+		_policyTable = _buildTable;
+		_buildTable = NULL;
+	}
+	pthread_mutex_unlock(&_reloadMutex);
+	ModePublishKinds();
+	ModePublishState();
+
 	err = pthread_mutex_init(&_cmdMutex, NULL);
 	_cmdMutexPtr = &_cmdMutex;
 	if(err == 0)
@@ -125,24 +519,65 @@ int32_t ModeManagerInitiallize()
 	{
 		(void)fprintf(stderr, "pthread_mutex_init failed \n");
 	}
-	_modemanagerStatus = true;
-	err = pthread_create(&_modemanagerThread, NULL, ModeManagerThread, NULL);
-	if(err != 0)
+	/* release deadlines are waited for on the monotonic clock */
+	pthread_condattr_t condAttr;
+	(void)pthread_condattr_init(&condAttr);
+	(void)pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	err = pthread_cond_init(&_cmdCond, &condAttr);
+	(void)pthread_condattr_destroy(&condAttr);
+	if(err == 0)
 	{
-		_modemanagerStatus = false;
+		_cmdCondPtr = &_cmdCond;
+	}
+	else
+	{
+		(void)fprintf(stderr, "pthread_cond_init failed \n");
+		ret = 0;
+	}
+	err = pthread_cond_init(&_doneCond, NULL);
+	if(err == 0)
+	{
+		_doneCondPtr = &_doneCond;
+	}
+	else
+	{
+		(void)fprintf(stderr, "pthread_cond_init failed \n");
 		ret = 0;
 	}
+	_modemanagerStatus = true;
+	if(_inlineArbitration)
+	{
+		TCLog(TCLogLevelInfo, "%s : inline arbitration\n", __FUNCTION__);
+	}
+	else
+	{
+		err = pthread_create(&_modemanagerThread, NULL, ModeManagerThread, NULL);
+		if(err != 0)
+		{
+			_modemanagerStatus = false;
+			ret = 0;
+		}
+	}
 	return ret;
 }
 
 void ModeManagerRelease()
 {
 	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
-	if(_modemanagerStatus)
+	if(_inlineArbitration)
+	{
+		pthread_mutex_lock(&_inlineMutex);
+		_modemanagerStatus = false;
+		pthread_mutex_unlock(&_inlineMutex);
+	}
+	else if(_modemanagerStatus)
 	{
 		void *res;
 		int32_t err;
+		pthread_mutex_lock(&_cmdMutex);
 		_modemanagerStatus = false;
+		pthread_cond_signal(&_cmdCond);
+		pthread_mutex_unlock(&_cmdMutex);
 		err = pthread_join(_modemanagerThread, &res);
 		if(err != 0)
 		{
@@ -159,526 +594,1941 @@ void ModeManagerRelease()
 			(void)fprintf(stderr, "pthread_mutex_destroy failed \n");
 		}
 	}
-}
 
-void setModeManagerSignalCB(ModeManagerSignalCB *cb)
-{
-	if(cb != NULL)
+	if(_cmdCondPtr != NULL)
 	{
-		_ChangedMode = cb->_ChangedMode;
-		_ReleaseResource = cb->_ReleaseResource;
-		_EndedMode = cb->_EndedMode;
-		_SuspendMode = cb->_SuspendMode;
-		_ResumeMode = cb->_ResumeMode;
+		int32_t err;
+		err = pthread_cond_destroy(_cmdCondPtr);
+		if(err != 0)
+		{
+			(void)fprintf(stderr, "pthread_cond_destroy failed \n");
+		}
+		_cmdCondPtr = NULL;
 	}
-}
-
-void setModePolicy(Mode policy)
-{
-	_policy.push_back(policy);
-}
-
-int32_t cmpModePriority(const char* mode, int32_t app)
-{
-	int32_t ret = 0;
-	Resource compare;
-	bool audio = true;
-	bool display = true;
-	bool tuner = true;
-	bool exclusive = true;
 
-	if(strncmp(mode, "idle", 4) == 0)
+	if(_doneCondPtr != NULL)
 	{
-		bool idle = false;
-		std::vector<Resource>::iterator iter;
-		for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+		int32_t err;
+		err = pthread_cond_destroy(_doneCondPtr);
+		if(err != 0)
 		{
-			if(iter->app == app)
-			{
-				idle = true;
-				break;
-			}
+			(void)fprintf(stderr, "pthread_cond_destroy failed \n");
 		}
+		_doneCondPtr = NULL;
+	}
+}
 
-		for(iter = _display.begin(); iter != _display.end(); ++iter)
+void getModeManagerStats(ModeManagerStats *stats)
+{
+	if(stats != NULL)
+	{
+		time_t now = ModeMonotonicSecond();
+		pthread_mutex_lock(&_cmdMutex);
+		stats->wakeups = _wakeupTotal;
+		stats->queueDepth = (uint32_t)_cmdQueue.size();
+		stats->queueHighWater = _cmdHighWater;
+		stats->queueDropped = _cmdDropped;
+		stats->releaseTimeouts = _releaseTimeoutTotal;
+		stats->requestsSuperseded = _supersededTotal;
+		stats->requestsMerged = _mergedTotal;
+		stats->decisionHits = __atomic_load_n(&_decisionHits, __ATOMIC_RELAXED);
+		stats->decisionMisses = __atomic_load_n(&_decisionMisses, __ATOMIC_RELAXED);
+		stats->decisionMismatches = __atomic_load_n(&_decisionMismatches, __ATOMIC_RELAXED);
+		stats->decisionStates = __atomic_load_n(&_decisionStateCount, __ATOMIC_RELAXED);
+		stats->signalsSent = __atomic_load_n(&_signalsSent, __ATOMIC_RELAXED);
+		stats->signalsCoalesced = __atomic_load_n(&_signalsCoalesced, __ATOMIC_RELAXED);
+		if(now == _wakeupSecond)
 		{
-			if(iter->app == app)
-			{
-				idle = true;
-				break;
-			}
+			stats->wakeupsPerSec = _wakeupLastCount;
 		}
-
-		if(idle)
+		else if(now == _wakeupSecond + 1)
 		{
-			compare = ModeFindwithinPolicy(mode, -1);
-			compare.app = app;
-			compare.state = 2; /* idle mode */
+			stats->wakeupsPerSec = _wakeupCount;
 		}
 		else
 		{
-			TCLog(TCLogLevelWarn, "%s : This App(%s) is not in Mode Lists\n", __FUNCTION__, mode);
+			stats->wakeupsPerSec = 0;
 		}
+		pthread_mutex_unlock(&_cmdMutex);
 	}
-	else
+}
+
+void setModeManagerInlineArbitration(int32_t enable)
+{
+	if(!_modemanagerStatus)
 	{
-		compare = ModeFindwithinPolicy(mode, app);
-		compare.state = 0; /* managering mode */
+		_inlineArbitration = (enable != 0);
 	}
-	if(compare.exclusive != 0)
+	else
 	{
-		exclusive = ModeExclusiveCheck(compare);
+		TCLog(TCLogLevelWarn, "%s : mode manager is already running\n", __FUNCTION__);
 	}
-	if(exclusive && compare.mode.empty() == false)
+}
+
+void setModeManagerDecisionCache(int32_t mode)
+{
+	if(!_modemanagerStatus)
 	{
-		if(compare.audio)
-		{
-			audio = ModeCompareAudio(compare);
-		}
-		if(compare.display)
-		{
-			display = ModeCompareDisplay(compare);
-		}
-		if(compare.tuner)
-		{
-			tuner = ModeCompareTuner(compare);
-		}
-		if(compare.audio && audio == true && display == false)
-		{
-			std::string bgMode = compare.mode;
-			bgMode.append("bg");
-			compare = ModeFindwithinPolicy(bgMode.c_str(), compare.app);
-			compare.state = 0; /* managering mode */
-			display = true;
-		}
-		if(audio && display && tuner)
-		{
-			pthread_mutex_lock(&_cmdMutex);
-			_cmdMode = compare;
-			pthread_mutex_unlock(&_cmdMutex);
-			ret = 1;
-		}
+		_decisionCache = mode;
 	}
-	if(compare.mode.empty() == false)
+	else
 	{
-		TCLog(TCLogLevelInfo, "%s %s, %d result : %d\n", __FUNCTION__, compare.mode.c_str(), compare.app, ret);
+		TCLog(TCLogLevelWarn, "%s : mode manager is already running\n", __FUNCTION__);
 	}
-	return ret;
 }
 
-void resumeMode(const char* mode, int32_t app)
+void setModeManagerSignalBatch(int32_t mode)
 {
-	bool end = false;
-	std::vector<Resource>::iterator iter;
-	std::string tmpMode = mode;
-	std::string bgMode = mode;
-	bgMode.append("bg");
-	for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+	if(!_modemanagerStatus)
 	{
-		if(iter->mode == mode)
-		{
-			end = true;
-			break;
-		}
-		else if(iter->mode == bgMode)
-		{
-			end = true;
-			tmpMode.append("bg");
-			break;
-		}
+		_signalBatch = mode;
 	}
-
-	for(iter = _display.begin(); iter != _display.end(); ++iter)
+	else
 	{
-		if(iter->mode == mode)
-		{
-			end = true;
-			break;
-		}
+		TCLog(TCLogLevelWarn, "%s : mode manager is already running\n", __FUNCTION__);
 	}
-	if(end)
+}
+
+void setModeManagerCoalesce(int32_t enable)
+{
+	if(!_modemanagerStatus)
 	{
-		_EndedMode(mode, app);
-		Resource resume;
-		resume = ModeFindwithinPolicy(tmpMode.c_str(), app);
-		resume.state = 1;
-		pthread_mutex_lock(&_cmdMutex);
-		_cmdMode = resume;
-		pthread_mutex_unlock(&_cmdMutex);
+		_coalesce = (enable != 0);
 	}
 	else
 	{
-		TCLog(TCLogLevelWarn, "%s This Mode is not in Resource Lists\n", __FUNCTION__);
+		TCLog(TCLogLevelWarn, "%s : mode manager is already running\n", __FUNCTION__);
 	}
 }
 
-void sendModeChanged(int32_t resources, int32_t app)
+int32_t getModeCoalescedRequests(ModeAppCoalesce *counters, int32_t max)
 {
-	RemoveReleaseResources(app, resources);
-
-	if(_relAppList.empty())
+	int32_t ret = 0;
+	std::map<int32_t, ModeAppCoalesce>::iterator iter;
+	pthread_mutex_lock(&_cmdMutex);
+	for(iter = _coalesced.begin(); (iter != _coalesced.end()) && (ret < max); ++iter)
 	{
-		if(resources & RELEASEDISPLAY)
-		{
-			if(!_display.empty())
-			{
-				if(_display.back().full == 0)
-				{
-					_ChangedMode("view", OSDAPP);
-				}
-				_ChangedMode(_display.back().mode.c_str(), _display.back().app);
-			}
-		}
-		else if(resources & RELEASEAUDIO)
-		{
-			if(!_audio.empty())
-			{
-				if(_audio.back().display != 0 && _audio.back().full == 0)
-				{
-					_ChangedMode("view", OSDAPP);
-				}
-				_ChangedMode(_audio.back().mode.c_str(), _audio.back().app);
-				if(_audio.back().app != _display.back().app)
-				{
-					_ChangedMode(_display.back().mode.c_str(), _display.back().app);
-				}
-			}
-		}
-		else if(resources & RELEASETUNER)
-		{
-			if(!_tuner.empty())
-			{
-				if(_tuner.back().display != 0 && _tuner.back().full == 0)
-				{
-					_ChangedMode("view", OSDAPP);
-				}
-				_ChangedMode(_tuner.back().mode.c_str(), _tuner.back().app);
-			}
-		}
+		counters[ret] = iter->second;
+		ret++;
 	}
+	pthread_mutex_unlock(&_cmdMutex);
+	return ret;
 }
 
-void systemSuspendMode()
+int32_t getModeReleaseTimeouts(ModeAppCounter *counters, int32_t max)
 {
-	ModeClearcmd();
-	_relAppList.clear();
-	if(_display.back().full == 0)
+	int32_t ret = 0;
+	std::map<int32_t, uint32_t>::iterator iter;
+	pthread_mutex_lock(&_cmdMutex);
+	for(iter = _releaseTimeouts.begin(); (iter != _releaseTimeouts.end()) && (ret < max); ++iter)
 	{
-		_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+		counters[ret].app = iter->first;
+		counters[ret].count = iter->second;
+		ret++;
 	}
-	_display.clear();
-	_audio.clear();
-	_tuner.clear();
-	_SuspendMode();
+	pthread_mutex_unlock(&_cmdMutex);
+	return ret;
 }
 
-void systemResumeMode()
+int32_t setModeReleaseTimeout(const char* resource, int32_t msec)
 {
-	_ResumeMode();
+	return setModeResource(resource, 0, msec);
 }
 
-static void ModeAllResourcePrint()
+/*
+ * Declares a resource kind, or finds the one of that name, and sets its release deadline.
+ * A mask of 0 takes the lowest RELEASExxx bit no other kind has. setModePolicy() ignores a
+ * kind not declared yet, so a loader declares every resource before the modes.
+ */
+int32_t setModeResource(const char* resource, int32_t mask, int32_t msec)
 {
-	std::vector<Resource>::iterator iter;
-	Resource res;
-
-	TCLog(TCLogLevelDebug, " Audio Resource\n");
-	for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+	int32_t ret = -1;
+	PolicyTable *table = ModeBuildTable();
+	int32_t kind = ModeTableFindKind(table, resource);
+	if(kind < 0)
 	{
-		res = *iter;
-		TCLog(TCLogLevelDebug, "  %s : %d \n", res.mode.c_str(), res.app);
+		kind = ModeDeclareKind(table, resource, mask);
 	}
-
-	TCLog(TCLogLevelDebug, " Display Resource\n");
-	for(iter = _display.begin(); iter != _display.end(); ++iter)
+	else if((mask != 0) && (mask != table->kinds[kind].mask))
 	{
-		res = *iter;
-		TCLog(TCLogLevelDebug,"  %s : %d \n", res.mode.c_str(), res.app);
+		TCLog(TCLogLevelWarn, "%s : %s keeps mask 0x%x, 0x%x ignored\n", __FUNCTION__, resource, table->kinds[kind].mask, mask);
 	}
-
-	TCLog(TCLogLevelDebug, " Tuner Resource\n");
-	for(iter = _tuner.begin(); iter != _tuner.end(); ++iter)
+	else
 	{
-		res = *iter;
-		TCLog(TCLogLevelDebug, "  %s : %d \n", res.mode.c_str(), res.app);
+		/* known kind */
 	}
-
-	std::vector<ReleaseApp>::iterator appiter;
-	ReleaseApp relApps;
-
-	TCLog(TCLogLevelDebug, " Release Apps\n");
-	for(appiter = _relAppList.begin(); appiter != _relAppList.end(); ++appiter)
+	if(kind >= 0)
 	{
-		relApps = *appiter;
-		TCLog(TCLogLevelDebug, "appID - %d resources : 0x%x \n", relApps.app, relApps.resource);
+		table->kinds[kind].timeout = (msec > 0) ? msec : 0;
+		ret = 0;
 	}
+	return ret;
 }
 
-static void ModeResume()
+void setModePolicyLoadCB(ModePolicyLoad_cb cb)
 {
-	TCLog(TCLogLevelDebug, "End mode : %s\n", _cmdMode.mode.c_str());
-	std::vector<Resource>::iterator iter;
-	bool resumeAudio = false, resumeDisplay = false, insertHome = false;
-	for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+	_PolicyLoad = cb;
+}
+
+/*
+ * Runs the load callback on the calling thread into a table of its own, so arbitration
+ * goes on meanwhile, then waits for the manager thread to swap it in. The stacks are
+ * re-resolved against the new table on the manager thread, which costs one lookup per
+ * stacked mode.
+ */
+int32_t reloadModePolicy()
+{
+	int32_t ret = -1;
+	uint64_t start = ModeStatsNow();
+	uint64_t parsed = start;
+	uint64_t swapped = start;
+	pthread_mutex_lock(&_reloadMutex);
+	if(_PolicyLoad == NULL)
 	{
-		if(*iter == _cmdMode)
-		{
-			if(*iter == _audio.back())
-			{
-				if(_audio.size() > 1)
-				{
-					resumeAudio = true;
-				}
-			}
-			_audio.erase(iter);
-			break;
-		}
+		TCLog(TCLogLevelWarn, "%s : no policy loader\n", __FUNCTION__);
 	}
-	for(iter = _display.begin(); iter != _display.end(); ++iter)
+	else
 	{
-		if(*iter == _cmdMode)
+		ModeReload reload;
+		delete _buildTable;
+		_buildTable = NULL;
+		(void)ModeBuildTable();
+		if(_PolicyLoad() == 0)
 		{
-			if(*iter == _display.back())
+			reload.table = _buildTable;
+			reload.swapped = false;
+			reload.waiter.done = false;
+			reload.waiter.result = 0;
+			_buildTable = NULL;
+			parsed = ModeStatsNow();
+			if(ModePostRequest(MODE_REQ_RELOAD, NULL, -1, 0, ModeReloadDone, &reload) && !_inlineArbitration)
 			{
-				if(_display.size() > 1)
-				{
-					resumeDisplay = true;
-				}
-				else
+				pthread_mutex_lock(&_cmdMutex);
+				while(!reload.waiter.done)
 				{
-					resumeDisplay = false;
+					(void)pthread_cond_wait(&_doneCond, &_cmdMutex);
 				}
+				pthread_mutex_unlock(&_cmdMutex);
 			}
-			if(*iter == _display.front())
+			swapped = ModeStatsNow();
+			if(reload.swapped)
 			{
-				insertHome = true;
+				ret = 0;
 			}
-			_display.erase(iter);
-			break;
+			else
+			{
+				TCLog(TCLogLevelWarn, "%s : manager is not running\n", __FUNCTION__);
+			}
+			/* the replaced table, or the new one if it was not swapped in, is freed here off the manager thread */
+			delete reload.table;
 		}
-	}
-	if(insertHome)
-	{
-		Resource defmode;
-		if(_display.empty())
+		else
 		{
-			resumeDisplay = true;
+			delete _buildTable;
+			_buildTable = NULL;
 		}
-		defmode = ModeFindwithinPolicy(DEFAULTMODE, DEFAULTAPP);
-		_display.insert(_display.begin(), defmode);
 	}
-	ModeChangeBackGround();
-	ModeRestoreBackGround();
+	pthread_mutex_unlock(&_reloadMutex);
+	if(ret == 0)
+	{
+		TCLog(TCLogLevelInfo, "%s : parsed in %llu usec, swapped in %llu usec\n", __FUNCTION__,
+			  (unsigned long long)((parsed - start) / 1000U), (unsigned long long)((swapped - parsed) / 1000U));
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s : policy in use is kept\n", __FUNCTION__);
+	}
+	return ret;
+}
 
-	if(resumeAudio && resumeDisplay)
+void setModeManagerTimerCB(ModeTimer_cb cb)
+{
+	_ModeTimer = cb;
+}
+
+void processModeManagerTimer()
+{
+	(void)ModePostRequest(MODE_REQ_TIMER, NULL, -1, 0, NULL, NULL);
+}
+
+void setModeManagerSignalCB(ModeManagerSignalCB *cb)
+{
+	if(cb != NULL)
 	{
-		if(_audio.back().app != _display.back().app)
+		_HostChangedMode = cb->_ChangedMode;
+		_HostReleaseResource = cb->_ReleaseResource;
+		_HostEndedMode = cb->_EndedMode;
+		_HostSuspendMode = cb->_SuspendMode;
+		_HostResumeMode = cb->_ResumeMode;
+		_HostTransition = cb->_Transition;
+		_ChangedMode = ModeSignalChangedMode;
+		_ReleaseResource = ModeSignalReleaseResource;
+		_EndedMode = ModeSignalEndedMode;
+		_SuspendMode = ModeSignalSuspendMode;
+		_ResumeMode = ModeSignalResumeMode;
+	}
+}
+
+void setModePolicy(Mode policy)
+{
+	PolicyTable *table = ModeBuildTable();
+	Policy entry;
+	uint32_t idx;
+	entry.mode = ModeInternName(table, policy.mode);
+	entry.app = policy.app;
+	(void)memset(entry.level, 0, sizeof(entry.level));
+	entry.level[KIND_AUDIO] = ModePolicyLevel(&policy, "audio", policy.audio);
+	entry.level[KIND_DISPLAY] = ModePolicyLevel(&policy, "display", policy.display);
+	entry.level[KIND_TUNER] = ModePolicyLevel(&policy, "tuner", policy.tuner);
+	for(idx = 0; (idx < policy.resourceCount) && (idx < (uint32_t)(RESOURCE_KINDS - KIND_BUILTIN)); idx++)
+	{
+		int32_t kind = ModeTableFindKind(table, policy.resources[idx].name);
+		if(kind >= KIND_BUILTIN)
 		{
-			_ChangedMode(_audio.back().mode.c_str(), _audio.back().app);
-			if(_display.back().full == 0)
-			{
-				_ChangedMode("view", OSDAPP);
-			}
-			else
-			{
-				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
-			}
-			_ChangedMode(_display.back().mode.c_str(), _display.back().app);
+			entry.level[kind] = ModePolicyLevel(&policy, policy.resources[idx].name, policy.resources[idx].level);
 		}
 		else
 		{
-			if(_display.back().full == 0)
-			{
-				_ChangedMode("view", OSDAPP);
-			}
-			else
-			{
-				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
-			}
-			_ChangedMode(_display.back().mode.c_str(), _display.back().app);
+			TCLog(TCLogLevelWarn, "%s : resource %s of mode %s app %d is not declared, ignored\n", __FUNCTION__,
+				  policy.resources[idx].name, policy.mode, policy.app);
 		}
 	}
-	else if(resumeAudio && resumeDisplay == false)
+	entry.full = policy.full;
+	entry.resume = policy.resume;
+	entry.mixing = policy.mixing;
+	entry.exclusive = policy.exclusive;
+	entry.background = -1;
+	entry.foreground = -1;
+
+	uint64_t key = ModePolicyKey(entry.mode, entry.app);
+	/* the first row of a (mode, app) pair wins, as the linear search did */
+	if(table->index.find(key) == table->index.end())
 	{
-		_ChangedMode(_audio.back().mode.c_str(), _audio.back().app);
+		int32_t index = (int32_t)table->policy.size();
+		table->index[key] = (uint32_t)index;
+		table->policy.push_back(entry);
+		ModeLinkBackGround(table, index);
 	}
-	else if(resumeDisplay && resumeAudio == false)
+	else
 	{
-		if(_display.back().full == 0)
+		TCLog(TCLogLevelWarn, "%s : duplicated mode %s app %d ignored\n", __FUNCTION__, policy.mode, policy.app);
+	}
+}
+
+int32_t cmpModePriority(const char* mode, int32_t app)
+{
+	ModeWaiter waiter;
+	waiter.done = false;
+	waiter.result = 0;
+	if(_inlineArbitration)
+	{
+		(void)ModePostRequest(MODE_REQ_CHANGE, mode, app, 0, ModeResultDone, &waiter);
+	}
+	else if(ModePostRequest(MODE_REQ_CHANGE, mode, app, 0, ModeWaiterDone, &waiter))
+	{
+		pthread_mutex_lock(&_cmdMutex);
+		while(!waiter.done)
 		{
-			_ChangedMode("view", OSDAPP);
+			(void)pthread_cond_wait(&_doneCond, &_cmdMutex);
 		}
-		else
+		pthread_mutex_unlock(&_cmdMutex);
+	}
+	return waiter.result;
+}
+
+void cmpModePriorityAsync(const char* mode, int32_t app, ChangeModeReply_cb reply, void *user)
+{
+	if(!ModePostRequest(MODE_REQ_CHANGE, mode, app, 0, reply, user))
+	{
+		if(reply != NULL)
 		{
-			_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			reply(0, "", app, NULL, 0, user);
 		}
-		_ChangedMode(_display.back().mode.c_str(), _display.back().app);
 	}
-	ModeAllResourcePrint();
+}
 
-	ModeClearcmd();
-	_relAppList.clear();
+int32_t changeModes(ModeBatchItem *items, int32_t count)
+{
+	ModeBatch batch;
+	ModeWaiter waiter;
+	waiter.done = false;
+	waiter.result = 0;
+	batch.items = items;
+	batch.count = count;
+	batch.reply = _inlineArbitration ? ModeResultDone : ModeWaiterDone;
+	batch.user = &waiter;
+	batch.owned = false;
+	if(ModePostRequest(MODE_REQ_BATCH, NULL, -1, 0, ModeBatchDone, &batch) && !_inlineArbitration)
+	{
+		pthread_mutex_lock(&_cmdMutex);
+		while(!waiter.done)
+		{
+			(void)pthread_cond_wait(&_doneCond, &_cmdMutex);
+		}
+		pthread_mutex_unlock(&_cmdMutex);
+	}
+	return waiter.result;
 }
 
-static void ModeShutdown()
+/* items stay the caller's until reply, which reads the per item results from them */
+void changeModesAsync(ModeBatchItem *items, int32_t count, ChangeModeReply_cb reply, void *user)
 {
-	TCLog(TCLogLevelDebug, "Shutdown app : %d\n", _cmdMode.app);
-	std::vector<Resource>::iterator iter;
-	bool resumeAudio = false, resumeDisplay = false, insertHome = false;
+	ModeBatch *batch = new ModeBatch;
+	batch->items = items;
+	batch->count = count;
+	batch->reply = reply;
+	batch->user = user;
+	batch->owned = true;
+	if(!ModePostRequest(MODE_REQ_BATCH, NULL, -1, 0, ModeBatchDone, batch))
+	{
+		delete batch;
+		if(reply != NULL)
+		{
+			reply(0, "", -1, NULL, 0, user);
+		}
+	}
+}
 
-	for(iter = _audio.begin(); iter != _audio.end();)
+void resumeMode(const char* mode, int32_t app)
+{
+	(void)ModePostRequest(MODE_REQ_END, mode, app, 0, NULL, NULL);
+}
+
+void sendModeChanged(int32_t resources, int32_t app)
+{
+	(void)ModePostRequest(MODE_REQ_RELEASED, NULL, app, resources, NULL, NULL);
+}
+
+void systemSuspendMode()
+{
+	(void)ModePostRequest(MODE_REQ_SUSPEND, NULL, -1, 0, NULL, NULL);
+}
+
+void systemResumeMode()
+{
+	(void)ModePostRequest(MODE_REQ_RESUME, NULL, -1, 0, NULL, NULL);
+}
+
+void shutdownMode(int32_t app)
+{
+	(void)ModePostRequest(MODE_REQ_SHUTDOWN, NULL, app, 0, NULL, NULL);
+}
+
+/*
+ * A change_mode is decided from the stacks alone, so a state seen before is answered from
+ * _decisionTables : the release list changes are replayed and the mode runs as the stack
+ * walk would have had it. ModeDecide() stays the reference, MODE_DECISION_VERIFY runs it
+ * for every request and checks the cache against it.
+ */
+static int32_t ModeProcessChange(const char* mode, int32_t app, Resource *changed)
+{
+	int32_t ret = 0;
+	int32_t modeId = ModeFindName(mode);
+	ModeDecision decision;
+	DecisionMap *decisions = NULL;
+	const ModeDecision *cached = NULL;
+	uint64_t key = ModePolicyKey(modeId, app);
+	uint32_t index;
+
+	if((_decisionCache != MODE_DECISION_OFF) && (modeId != MODE_NONE))
 	{
-		if(iter->app == _cmdMode.app)
+		decisions = &_decisionTables[ModeDecisionState()];
+		DecisionMap::const_iterator iter = decisions->find(key);
+		if(iter != decisions->end())
 		{
-			if(_audio.size() > 1 && *iter == _audio.back())
+			cached = &iter->second;
+		}
+	}
+	if((cached != NULL) && (_decisionCache == MODE_DECISION_CACHE))
+	{
+		decision = *cached;
+		for(index = 0; index < decision.opCount; index++)
+		{
+			if(decision.ops[index].remove != 0)
 			{
-				resumeAudio = true;
+				RemoveReleaseResources(decision.ops[index].app, decision.ops[index].resource);
 			}
 			else
 			{
-				resumeAudio = false;
+				AddReleaseResources(decision.ops[index].app, decision.ops[index].resource);
 			}
-			_audio.erase(iter);
+		}
+		__atomic_add_fetch(&_decisionHits, 1U, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		ModeDecide(mode, modeId, app, &decision);
+		if(cached == NULL)
+		{
+			/* not a miss with the cache off, there was nothing to look up */
+			if(_decisionCache != MODE_DECISION_OFF)
+			{
+				__atomic_add_fetch(&_decisionMisses, 1U, __ATOMIC_RELAXED);
+			}
+		}
+		else if(ModeDecisionEqual(cached, &decision))
+		{
+			/* verified, counted as the hit it would have been */
+			__atomic_add_fetch(&_decisionHits, 1U, __ATOMIC_RELAXED);
 		}
 		else
 		{
-			++iter;
+			TCLog(TCLogLevelError, "%s : cached decision for %s app %d differs from the stacks\n", __FUNCTION__, mode, app);
+			__atomic_add_fetch(&_decisionMismatches, 1U, __ATOMIC_RELAXED);
+		}
+		if((decisions != NULL) && (decision.opCount <= DECISION_OPS))
+		{
+			(*decisions)[key] = decision;
 		}
 	}
-	for(iter = _display.begin(); iter != _display.end();)
+	if(decision.result != 0)
 	{
-		if(iter->app == _cmdMode.app)
+		_cmdMode = decision.compare;
+		ModeRunCommand();
+		*changed = decision.compare;
+		ret = 1;
+	}
+	if(decision.compare.mode != MODE_NONE)
+	{
+		TCLog(TCLogLevelInfo, "%s %s, %d result : %d\n", __FUNCTION__, ModeName(decision.compare.mode), decision.compare.app, ret);
+	}
+	return ret;
+}
+
+/* walks the stacks, the release list changes are made as they are found and recorded */
+static void ModeDecide(const char* mode, int32_t modeId, int32_t app, ModeDecision *decision)
+{
+	Resource compare = ModeNoneResource();
+	bool audio = true;
+	bool display = true;
+	bool kinds = true;
+	bool exclusive = true;
+
+	decision->result = 0;
+	decision->opCount = 0;
+	_decisionRecord = decision;
+	if(strncmp(mode, "idle", 4) == 0)
+	{
+		bool idle = false;
+		std::vector<Resource>::iterator iter;
+		for(iter = _audio.begin(); iter != _audio.end(); ++iter)
 		{
-			if(_display.size() > 1 && *iter == _display.back())
-			{
-				resumeDisplay = true;
-			}
-			else
+			if(iter->app == app)
 			{
-				resumeDisplay = false;
+				idle = true;
+				break;
 			}
-			if(*iter == _display.front())
+		}
+
+		for(iter = _display.begin(); iter != _display.end(); ++iter)
+		{
+			if(iter->app == app)
 			{
-				insertHome = true;
+				idle = true;
+				break;
 			}
-			_display.erase(iter);
+		}
+
+		if(idle)
+		{
+			compare = ModeFindwithinPolicy(modeId, -1);
+			compare.app = app;
+			compare.state = 2; /* idle mode */
 		}
 		else
 		{
-			++iter;
+			TCLog(TCLogLevelWarn, "%s : This App(%s) is not in Mode Lists\n", __FUNCTION__, mode);
 		}
 	}
-	for(iter = _tuner.begin(); iter != _tuner.end();)
+	else
 	{
-		if(iter->app == _cmdMode.app)
+		compare = ModeFindwithinPolicy(modeId, app);
+		compare.state = 0; /* managering mode */
+	}
+	if(compare.exclusive != 0)
+	{
+		exclusive = ModeExclusiveCheck(compare);
+	}
+	if(exclusive && compare.mode != MODE_NONE)
+	{
+		if(compare.level[KIND_AUDIO])
 		{
-			_tuner.erase(iter);
+			audio = ModeCompareAudio(compare);
 		}
-		else
+		if(compare.level[KIND_DISPLAY])
 		{
-			++iter;
+			display = ModeCompareDisplay(compare);
+		}
+		kinds = _kinds->compare(&compare);
+		if(compare.level[KIND_AUDIO] && audio == true && display == false)
+		{
+			compare = ModePolicyResource(ModePolicyBackground(compare.policy));
+			compare.state = 0; /* managering mode */
+			display = true;
+		}
+		if(audio && display && kinds && compare.mode != MODE_NONE)
+		{
+			decision->result = 1;
 		}
 	}
-	if(insertHome)
+	decision->compare = compare;
+	_decisionRecord = NULL;
+}
+
+/*
+ * The calls of a batch run in a row with no other request in between. Their signals are
+ * coalesced by the one ModeSignalFlush() of the request and the state page only shows
+ * where the batch ended, so no app or reader sees the states in between.
+ */
+static int32_t ModeProcessBatch(ModeBatch *batch)
+{
+	int32_t ret = 0;
+	int32_t index;
+	_publishHeld = true;
+	for(index = 0; index < batch->count; index++)
 	{
-		Resource defmode;
-		if(_display.empty())
+		ModeBatchItem *item = &batch->items[index];
+		int32_t modeId = ModeFindName(item->mode);
+		Resource changed = ModeNoneResource();
+		item->result = 0;
+		if(item->op == MODE_BATCH_CHANGE)
 		{
-			resumeDisplay = true;
+			item->result = ModeProcessChange(item->mode, item->app, &changed);
+			ModeRecordTrace(ModeTraceChange, (item->result != 0) ? changed.mode : modeId, item->app, item->result, 0);
 		}
-		defmode = ModeFindwithinPolicy("home", 0);
-		_display.insert(_display.begin(), defmode);
+		else if(item->op == MODE_BATCH_END)
+		{
+			ModeProcessEnd(item->mode, item->app);
+			ModeRecordTrace(ModeTraceEndMode, modeId, item->app, 0, 0);
+		}
+		else
+		{
+			TCLog(TCLogLevelWarn, "%s : unknown op %d for %s app %d\n", __FUNCTION__, item->op, item->mode, item->app);
+		}
+		(void)strncpy(item->changed, ModeName(changed.mode), sizeof(item->changed) - 1U);
+		item->changed[sizeof(item->changed) - 1U] = '\0';
+		if(item->result != 0)
+		{
+			ret++;
+		}
+	}
+	_publishHeld = false;
+	ModePublishState();
+	TCLog(TCLogLevelInfo, "%s : %d changes of %d\n", __FUNCTION__, ret, batch->count);
+	return ret;
+}
+
+static void ModeBatchDone(int32_t result, const char *mode, int32_t app,
+						  const ReleaseApp *released, int32_t count, void *user)
+{
+	(void)mode;
+	(void)app;
+	ModeBatch *batch = (ModeBatch *)user;
+	if(batch->reply != NULL)
+	{
+		batch->reply(result, "", -1, released, count, batch->user);
+	}
+	if(batch->owned)
+	{
+		delete batch;
+	}
+}
+
+static void ModeProcessEnd(const char* mode, int32_t app)
+{
+	bool end = false;
+	std::vector<Resource>::iterator iter;
+	int32_t modeId = ModeFindName(mode);
+	int32_t bgModeId = MODE_NONE;
+	int32_t tmpMode = modeId;
+	int32_t background = ModePolicyBackground(ModeFindPolicy(modeId, app));
+	if(background >= 0)
+	{
+		bgModeId = _policyTable->policy[background].mode;
+	}
+	for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+	{
+		if(iter->mode == modeId)
+		{
+			end = true;
+			break;
+		}
+		else if(iter->mode == bgModeId)
+		{
+			end = true;
+			tmpMode = bgModeId;
+			break;
+		}
+	}
+
+	for(iter = _display.begin(); iter != _display.end(); ++iter)
+	{
+		if(iter->mode == modeId)
+		{
+			end = true;
+			break;
+		}
+	}
+	if(end)
+	{
+		_EndedMode(mode, app);
+		Resource resume;
+		resume = ModeFindwithinPolicy(tmpMode, app);
+		resume.state = 1;
+		if(resume.mode != MODE_NONE)
+		{
+			_cmdMode = resume;
+			ModeRunCommand();
+		}
+	}
+	else
+	{
+		TCLog(TCLogLevelWarn, "%s This Mode is not in Resource Lists\n", __FUNCTION__);
+	}
+}
+
+static void ModeProcessReleaseDone(int32_t resources, int32_t app)
+{
+	RemoveReleaseResources(app, resources);
+
+	if(_relAppList.empty())
+	{
+		ModeTimerClear();
+		if(resources & RELEASEDISPLAY)
+		{
+			if(!_display.empty())
+			{
+				if(_display.back().full == 0)
+				{
+					_ChangedMode("view", OSDAPP);
+				}
+				_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+			}
+		}
+		else if(resources & RELEASEAUDIO)
+		{
+			if(!_audio.empty())
+			{
+				if(_audio.back().level[KIND_DISPLAY] != 0 && _audio.back().full == 0)
+				{
+					_ChangedMode("view", OSDAPP);
+				}
+				_ChangedMode(ModeName(_audio.back().mode), _audio.back().app);
+				if(!_display.empty() && _audio.back().app != _display.back().app)
+				{
+					_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+				}
+			}
+		}
+		else
+		{
+			uint32_t kind;
+			for(kind = KIND_TUNER; kind < _policyTable->kindCount; kind++)
+			{
+				if(resources & _policyTable->kinds[kind].mask)
+				{
+					const std::vector<Resource> &stack = _stacks[kind];
+					if(!stack.empty())
+					{
+						if(stack.back().level[KIND_DISPLAY] != 0 && stack.back().full == 0)
+						{
+							_ChangedMode("view", OSDAPP);
+						}
+						_ChangedMode(ModeName(stack.back().mode), stack.back().app);
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void ModeProcessSuspend()
+{
+	uint32_t kind;
+	_decisionDirty = true;
+	ModeClearcmd();
+	_relAppList.clear();
+	ModeTimerClear();
+	if(!_display.empty() && _display.back().full == 0)
+	{
+		_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+	}
+	for(kind = 0; kind < RESOURCE_KINDS; kind++)
+	{
+		_stacks[kind].clear();
+	}
+	ModePublishState();
+	_SuspendMode();
+}
+
+static void ModeProcessShutdown(int32_t app)
+{
+	bool holding = false;
+	int32_t pending = 0;
+	uint32_t kind;
+	std::vector<Resource>::iterator iter;
+	std::vector<ReleaseApp>::iterator appiter;
+
+	/* the app will never answer release_resource, let the waiting transition finish */
+	for(appiter = _relAppList.begin(); appiter != _relAppList.end(); ++appiter)
+	{
+		if(appiter->app == app)
+		{
+			pending = appiter->resource;
+			break;
+		}
+	}
+	if(pending != 0)
+	{
+		ModeProcessReleaseDone(pending, app);
+	}
+
+	for(kind = 0; (kind < RESOURCE_KINDS) && !holding; kind++)
+	{
+		for(iter = _stacks[kind].begin(); (iter != _stacks[kind].end()) && !holding; ++iter)
+		{
+			holding = (iter->app == app);
+		}
+	}
+	if(holding)
+	{
+		_cmdMode = ModeNoneResource();
+		_cmdMode.app = app;
+		_cmdMode.state = 2; /* idle mode */
+		ModeRunCommand();
+	}
+	TCLog(TCLogLevelInfo, "%s : App(%d) pending release %d, holding resources %d\n", __FUNCTION__, app, pending, holding ? 1 : 0);
+}
+
+/*
+ * Swaps the new table in. Nothing but this thread reads the table, so the old one is
+ * handed back to reloadModePolicy() to free it outside the manager thread. Stacked modes
+ * keep their place and take the new attributes, a mode the new policy dropped keeps its
+ * old ones until it ends. Resource kinds only come in addition, the stacks stay valid.
+ */
+static int32_t ModeProcessReload(ModeReload *reload)
+{
+	PolicyTable *old = _policyTable;
+	uint32_t dropped = 0;
+	uint32_t kind;
+	uint32_t idx;
+	__atomic_store_n(&_policyTable, reload->table, __ATOMIC_RELEASE);
+	reload->table = (old != &_emptyTable) ? old : NULL;
+	reload->swapped = true;
+	ModePublishKinds();
+	for(kind = 0; kind < RESOURCE_KINDS; kind++)
+	{
+		for(idx = 0; idx < _stacks[kind].size(); idx++)
+		{
+			dropped += ModeResolveResource(&_stacks[kind][idx]) ? 0U : 1U;
+		}
+	}
+	(void)ModeResolveResource(&_cmdMode);
+	ModeDecisionFlush();
+	ModePublishState();
+	ModeRecordTrace(ModeTraceReload, MODE_NONE, -1, (int32_t)_policyTable->policy.size(), 0);
+	TCLog(TCLogLevelInfo, "%s : %u modes, %u stacked modes no longer in the policy\n", __FUNCTION__,
+		  (uint32_t)_policyTable->policy.size(), dropped);
+	return 1;
+}
+
+static bool ModeResolveResource(Resource *resource)
+{
+	bool ret = true;
+	if(resource->mode != MODE_NONE)
+	{
+		int32_t policy = ModeFindPolicy(resource->mode, resource->app);
+		if(policy >= 0)
+		{
+			uint8_t state = resource->state;
+			*resource = ModePolicyResource(policy);
+			resource->state = state;
+		}
+		else
+		{
+			resource->policy = -1;
+			ret = false;
+		}
+	}
+	return ret;
+}
+
+static void ModeAllResourcePrint()
+{
+	std::vector<Resource>::iterator iter;
+	Resource res;
+	uint32_t kind;
+
+	for(kind = 0; kind < _policyTable->kindCount; kind++)
+	{
+		TCLog(TCLogLevelDebug, " %s Resource\n", _policyTable->kinds[kind].name.c_str());
+		for(iter = _stacks[kind].begin(); iter != _stacks[kind].end(); ++iter)
+		{
+			res = *iter;
+			TCLog(TCLogLevelDebug, "  %s : %d \n", ModeName(res.mode), res.app);
+		}
+	}
+
+	std::vector<ReleaseApp>::iterator appiter;
+	ReleaseApp relApps;
+
+	TCLog(TCLogLevelDebug, " Release Apps\n");
+	for(appiter = _relAppList.begin(); appiter != _relAppList.end(); ++appiter)
+	{
+		relApps = *appiter;
+		TCLog(TCLogLevelDebug, "appID - %d resources : 0x%x \n", relApps.app, relApps.resource);
+	}
+}
+
+static void ModeResume()
+{
+	TCLog(TCLogLevelDebug, "End mode : %s\n", ModeName(_cmdMode.mode));
+	std::vector<Resource>::iterator iter;
+	bool resumeAudio = false, resumeDisplay = false, insertHome = false;
+	for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+	{
+		if(*iter == _cmdMode)
+		{
+			if(*iter == _audio.back())
+			{
+				if(_audio.size() > 1)
+				{
+					resumeAudio = true;
+				}
+			}
+			_audio.erase(iter);
+			break;
+		}
+	}
+	for(iter = _display.begin(); iter != _display.end(); ++iter)
+	{
+		if(*iter == _cmdMode)
+		{
+			if(*iter == _display.back())
+			{
+				if(_display.size() > 1)
+				{
+					resumeDisplay = true;
+				}
+				else
+				{
+					resumeDisplay = false;
+				}
+			}
+			if(*iter == _display.front())
+			{
+				insertHome = true;
+			}
+			_display.erase(iter);
+			break;
+		}
+	}
+	if(insertHome)
+	{
+		Resource defmode;
+		if(_display.empty())
+		{
+			resumeDisplay = true;
+		}
+		defmode = ModeFindwithinPolicy(ModeFindName(DEFAULTMODE), DEFAULTAPP);
+		_display.insert(_display.begin(), defmode);
 	}
 	ModeChangeBackGround();
 	ModeRestoreBackGround();
+	/* the background pass may have emptied a stack the flags were set for */
+	resumeAudio = resumeAudio && !_audio.empty();
+	resumeDisplay = resumeDisplay && !_display.empty();
+
 	if(resumeAudio && resumeDisplay)
 	{
 		if(_audio.back().app != _display.back().app)
 		{
-			_ChangedMode(_audio.back().mode.c_str(), _audio.back().app);
+			_ChangedMode(ModeName(_audio.back().mode), _audio.back().app);
+			if(_display.back().full == 0)
+			{
+				_ChangedMode("view", OSDAPP);
+			}
+			else
+			{
+				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			}
+			_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+		}
+		else
+		{
 			if(_display.back().full == 0)
 			{
 				_ChangedMode("view", OSDAPP);
 			}
 			else
 			{
-				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			}
+			_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+		}
+	}
+	else if(resumeAudio && resumeDisplay == false)
+	{
+		_ChangedMode(ModeName(_audio.back().mode), _audio.back().app);
+	}
+	else if(resumeDisplay && resumeAudio == false)
+	{
+		if(_display.back().full == 0)
+		{
+			_ChangedMode("view", OSDAPP);
+		}
+		else
+		{
+			_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+		}
+		_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+	}
+	ModeAllResourcePrint();
+	ModePublishState();
+
+	ModeClearcmd();
+	_relAppList.clear();
+	ModeTimerClear();
+}
+
+static void ModeShutdown()
+{
+	TCLog(TCLogLevelDebug, "Shutdown app : %d\n", _cmdMode.app);
+	std::vector<Resource>::iterator iter;
+	bool resumeAudio = false, resumeDisplay = false, insertHome = false;
+	uint32_t kind;
+
+	for(iter = _audio.begin(); iter != _audio.end();)
+	{
+		if(iter->app == _cmdMode.app)
+		{
+			if(_audio.size() > 1 && *iter == _audio.back())
+			{
+				resumeAudio = true;
+			}
+			else
+			{
+				resumeAudio = false;
+			}
+			iter = _audio.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	for(iter = _display.begin(); iter != _display.end();)
+	{
+		if(iter->app == _cmdMode.app)
+		{
+			if(_display.size() > 1 && *iter == _display.back())
+			{
+				resumeDisplay = true;
+			}
+			else
+			{
+				resumeDisplay = false;
+			}
+			if(*iter == _display.front())
+			{
+				insertHome = true;
+			}
+			iter = _display.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	for(kind = KIND_TUNER; kind < RESOURCE_KINDS; kind++)
+	{
+		for(iter = _stacks[kind].begin(); iter != _stacks[kind].end();)
+		{
+			if(iter->app == _cmdMode.app)
+			{
+				iter = _stacks[kind].erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+	if(insertHome)
+	{
+		Resource defmode;
+		if(_display.empty())
+		{
+			resumeDisplay = true;
+		}
+		defmode = ModeFindwithinPolicy(ModeFindName("home"), 0);
+		_display.insert(_display.begin(), defmode);
+	}
+	ModeChangeBackGround();
+	ModeRestoreBackGround();
+	/* the background pass may have emptied a stack the flags were set for */
+	resumeAudio = resumeAudio && !_audio.empty();
+	resumeDisplay = resumeDisplay && !_display.empty();
+	if(resumeAudio && resumeDisplay)
+	{
+		if(_audio.back().app != _display.back().app)
+		{
+			_ChangedMode(ModeName(_audio.back().mode), _audio.back().app);
+			if(_display.back().full == 0)
+			{
+				_ChangedMode("view", OSDAPP);
+			}
+			else
+			{
+				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			}
+			_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+		}
+		else
+		{
+			if(_display.back().full == 0)
+			{
+				_ChangedMode("view", OSDAPP);
+			}
+			else
+			{
+				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			}
+			_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+		}
+	}
+	else if(resumeAudio)
+	{
+		_ChangedMode(ModeName(_audio.back().mode), _audio.back().app);
+	}
+	else if(resumeDisplay)
+	{
+		if(_display.back().full == 0)
+		{
+			_ChangedMode("view", OSDAPP);
+		}
+		else
+		{
+			_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+		}
+		_ChangedMode(ModeName(_display.back().mode), _display.back().app);
+	}
+
+	ModeAllResourcePrint();
+	ModePublishState();
+
+	ModeClearcmd();
+	_relAppList.clear();
+	ModeTimerClear();
+}
+
+static void ModeClearcmd()
+{
+	_cmdMode = ModeNoneResource();
+}
+
+static void ModeRunCommand()
+{
+	_decisionDirty = true;
+	if(_cmdMode.state == 0)
+	{
+		uint64_t start = ModeStatsNow();
+		ModeManagerResources();
+		ModeStatsRecord(ModeStatsChangeMode, ModeStatsResources, ModeStatsNow() - start);
+	}
+	else if(_cmdMode.state == 1)
+	{
+		ModeResume();
+	}
+	else if(_cmdMode.state == 2)
+	{
+		ModeShutdown();
+	}
+	else
+	{
+		TCLog(TCLogLevelDebug, "ModeManager Waiting\n");
+		ModeClearcmd();
+	}
+}
+
+static bool ModePostRequest(int32_t type, const char* mode, int32_t app, int32_t resources,
+							ChangeModeReply_cb done, void *user)
+{
+	bool ret = false;
+	ModeRequest request;
+	request.type = type;
+	request.mode[0] = '\0';
+	if(mode != NULL)
+	{
+		(void)strncpy(request.mode, mode, sizeof(request.mode) - 1);
+		request.mode[sizeof(request.mode) - 1] = '\0';
+	}
+	request.app = app;
+	request.resources = resources;
+	request.done = done;
+	request.user = user;
+	request.posted = ModeStatsNow();
+	request.merged = NULL;
+
+	if(_inlineArbitration)
+	{
+		pthread_mutex_lock(&_inlineMutex);
+		if(_modemanagerStatus)
+		{
+			ModeProcessRequest(&request);
+			ModeTimerExpire();
+			ModeTimerArm();
+			ret = true;
+		}
+		pthread_mutex_unlock(&_inlineMutex);
+	}
+	else
+	{
+		int32_t coalesced = 0;
+		ModeRequest superseded;
+		pthread_mutex_lock(&_cmdMutex);
+		if(_modemanagerStatus && _coalesce && (type == MODE_REQ_CHANGE) && (app >= 0))
+		{
+			coalesced = ModeCoalesceRequest(&request, &superseded);
+		}
+		if(coalesced == 1)
+		{
+			ret = true;
+		}
+		else if(_modemanagerStatus && (_cmdQueue.size() < CMDQUEUE_MAX))
+		{
+			_cmdQueue.push_back(request);
+			if(_cmdQueue.size() > _cmdHighWater)
+			{
+				_cmdHighWater = (uint32_t)_cmdQueue.size();
+			}
+			pthread_cond_signal(&_cmdCond);
+			ret = true;
+		}
+		else
+		{
+			_cmdDropped++;
+		}
+		pthread_mutex_unlock(&_cmdMutex);
+		if(coalesced == 2)
+		{
+			/* off _cmdMutex, a waiter takes it to be woken */
+			TCLog(TCLogLevelDebug, "%s : %s of app %d superseded by %s\n", __FUNCTION__, superseded.mode, app, mode);
+			if(superseded.done != NULL)
+			{
+				superseded.done(MODE_CHANGE_SUPERSEDED, "", app, NULL, 0, superseded.user);
+			}
+			ModeReplyMerged(&superseded, MODE_CHANGE_SUPERSEDED, "", app, NULL, 0);
+		}
+	}
+	if(!ret)
+	{
+		TCLog(TCLogLevelWarn, "%s : request %d of app %d dropped\n", __FUNCTION__, type, app);
+	}
+	return ret;
+}
+
+/*
+ * _cmdMutex held. Only the last queued request of the app is looked at, so nothing of the
+ * app is reordered : 1 if request joined it, 2 if it was a change_mode to another mode,
+ * which is taken out to superseded for the caller to answer, 0 if request is to be queued.
+ */
+static int32_t ModeCoalesceRequest(const ModeRequest *request, ModeRequest *superseded)
+{
+	int32_t ret = 0;
+	bool found = false;
+	std::deque<ModeRequest>::iterator iter = _cmdQueue.end();
+	while((iter != _cmdQueue.begin()) && !found)
+	{
+		--iter;
+		found = (iter->app == request->app);
+	}
+	if(found && (iter->type == MODE_REQ_CHANGE))
+	{
+		ModeAppCoalesce *counter = &_coalesced[request->app];
+		counter->app = request->app;
+		if(strcmp(iter->mode, request->mode) == 0)
+		{
+			ModeReplyTo **last = &iter->merged;
+			while(*last != NULL)
+			{
+				last = &(*last)->next;
+			}
+			*last = new ModeReplyTo;
+			(*last)->done = request->done;
+			(*last)->user = request->user;
+			(*last)->next = NULL;
+			counter->merged++;
+			_mergedTotal++;
+			ret = 1;
+		}
+		else if(ModeCoalesceCovers(iter->mode, request->mode, request->app))
+		{
+			const ModeReplyTo *reply;
+			*superseded = *iter;
+			(void)_cmdQueue.erase(iter);
+			for(reply = superseded->merged; reply != NULL; reply = reply->next)
+			{
+				counter->superseded++;
+				_supersededTotal++;
+			}
+			counter->superseded++;
+			_supersededTotal++;
+			ret = 2;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Whether running newer alone ends where older then newer would : newer takes every kind
+ * older holds, so older's holdings and the releases it asks for are all redone by newer.
+ * idle is never skipped, it gives up what the app holds. The table can not be freed under
+ * _cmdMutex, reloadModePolicy() frees it once the swap is answered, which takes the lock.
+ */
+static bool ModeCoalesceCovers(const char *older, const char *newer, int32_t app)
+{
+	bool ret = false;
+	const PolicyTable *table = __atomic_load_n(&_policyTable, __ATOMIC_ACQUIRE);
+	if((strncmp(older, "idle", 4) != 0) && (strncmp(newer, "idle", 4) != 0))
+	{
+		int32_t olderPolicy = ModeTableFindPolicy(table, ModeTableFindName(table, older), app);
+		int32_t newerPolicy = ModeTableFindPolicy(table, ModeTableFindName(table, newer), app);
+		if((olderPolicy >= 0) && (newerPolicy >= 0))
+		{
+			const Policy *from = &table->policy[olderPolicy];
+			const Policy *to = &table->policy[newerPolicy];
+			uint32_t kind;
+			ret = true;
+			for(kind = 0; (kind < table->kindCount) && ret; kind++)
+			{
+				if((from->level[kind] != 0) && (to->level[kind] == 0))
+				{
+					ret = false;
+				}
+			}
+		}
+	}
+	return ret;
+}
+
+/* the callers merged into request get its reply too */
+static void ModeReplyMerged(const ModeRequest *request, int32_t result, const char *mode, int32_t app,
+							const ReleaseApp *released, int32_t count)
+{
+	ModeReplyTo *reply = request->merged;
+	while(reply != NULL)
+	{
+		ModeReplyTo *next = reply->next;
+		if(reply->done != NULL)
+		{
+			reply->done(result, mode, app, released, count, reply->user);
+		}
+		delete reply;
+		reply = next;
+	}
+}
+
+static void ModeWaiterDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user)
+{
+	(void)mode;
+	(void)app;
+	(void)released;
+	(void)count;
+	ModeWaiter *waiter = (ModeWaiter *)user;
+	pthread_mutex_lock(&_cmdMutex);
+	waiter->result = result;
+	waiter->done = true;
+	pthread_cond_broadcast(&_doneCond);
+	pthread_mutex_unlock(&_cmdMutex);
+}
+
+static void ModeReloadDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user)
+{
+	ModeReload *reload = (ModeReload *)user;
+	if(_inlineArbitration)
+	{
+		ModeResultDone(result, mode, app, released, count, &reload->waiter);
+	}
+	else
+	{
+		ModeWaiterDone(result, mode, app, released, count, &reload->waiter);
+	}
+}
+
+static void ModeResultDone(int32_t result, const char *mode, int32_t app,
+						   const ReleaseApp *released, int32_t count, void *user)
+{
+	(void)mode;
+	(void)app;
+	(void)released;
+	(void)count;
+	ModeWaiter *waiter = (ModeWaiter *)user;
+	waiter->result = result;
+	waiter->done = true;
+}
+
+static void ModeProcessRequest(const ModeRequest *request)
+{
+	int32_t result = 0;
+	Resource changed = ModeNoneResource();
+	uint64_t start = ModeStatsNow();
+	uint64_t end;
+	int32_t method = -1;
+	int32_t modeId = MODE_NONE;
+	if((request->type == MODE_REQ_CHANGE) || (request->type == MODE_REQ_END))
+	{
+		modeId = ModeFindName(request->mode);
+	}
+	if(request->type != MODE_REQ_TIMER)
+	{
+		ModeRecordTrace(ModeTraceQueued, modeId, request->app, request->type, request->posted);
+	}
+	if(request->type == MODE_REQ_CHANGE)
+	{
+		result = ModeProcessChange(request->mode, request->app, &changed);
+		ModeRecordTrace(ModeTraceChange, (result != 0) ? changed.mode : modeId, request->app, result, 0);
+	}
+	else if(request->type == MODE_REQ_END)
+	{
+		ModeProcessEnd(request->mode, request->app);
+		ModeRecordTrace(ModeTraceEndMode, modeId, request->app, 0, 0);
+	}
+	else if(request->type == MODE_REQ_RELEASED)
+	{
+		ModeProcessReleaseDone(request->resources, request->app);
+		ModeRecordTrace(ModeTraceReleaseDone, MODE_NONE, request->app, request->resources, 0);
+	}
+	else if(request->type == MODE_REQ_SUSPEND)
+	{
+		ModeProcessSuspend();
+		ModeRecordTrace(ModeTraceSuspend, MODE_NONE, request->app, 0, 0);
+	}
+	else if(request->type == MODE_REQ_RESUME)
+	{
+		_ResumeMode();
+		ModeRecordTrace(ModeTraceResume, MODE_NONE, request->app, 0, 0);
+	}
+	else if(request->type == MODE_REQ_SHUTDOWN)
+	{
+		ModeProcessShutdown(request->app);
+		ModeRecordTrace(ModeTraceShutdown, MODE_NONE, request->app, 0, 0);
+	}
+	else if(request->type == MODE_REQ_RELOAD)
+	{
+		result = ModeProcessReload((ModeReload *)request->user);
+	}
+	else if(request->type == MODE_REQ_BATCH)
+	{
+		result = ModeProcessBatch((ModeBatch *)request->user);
+	}
+	else if(request->type == MODE_REQ_TIMER)
+	{
+		/* the host timer fired, expiry itself runs after every request */
+		_timerArmed = 0;
+	}
+	else
+	{
+		TCLog(TCLogLevelWarn, "%s : unknown request %d\n", __FUNCTION__, request->type);
+	}
+	ModeSignalFlush();
+	if(result != 0)
+	{
+		/* _relAppList now holds the apps that were asked to release for this change */
+		if(request->done != NULL)
+		{
+			request->done(result, ModeName(changed.mode), changed.app,
+						  _relAppList.data(), (int32_t)_relAppList.size(), request->user);
+		}
+		ModeReplyMerged(request, result, ModeName(changed.mode), changed.app,
+						_relAppList.data(), (int32_t)_relAppList.size());
+	}
+	else
+	{
+		if(request->done != NULL)
+		{
+			request->done(result, "", request->app, NULL, 0, request->user);
+		}
+		ModeReplyMerged(request, result, "", request->app, NULL, 0);
+	}
+	end = ModeStatsNow();
+	if((request->type >= 0) && (request->type < (int32_t)(sizeof(_statsMethod) / sizeof(_statsMethod[0]))))
+	{
+		method = _statsMethod[request->type];
+	}
+	ModeStatsRecord(method, ModeStatsQueue, start - request->posted);
+	ModeStatsRecord(method, ModeStatsRun, end - start);
+	ModeStatsRecord(method, ModeStatsTotal, end - request->posted);
+}
+
+static time_t ModeMonotonicSecond()
+{
+	struct timespec now;
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+static uint64_t ModeMonotonicTick()
+{
+	struct timespec now;
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return (((uint64_t)now.tv_sec * 1000U) + ((uint64_t)now.tv_nsec / 1000000U)) / TIMERWHEEL_TICK;
+}
+
+static void ModeTimerAdd(int32_t app, int32_t resources)
+{
+	uint32_t idx;
+	uint64_t now = ModeMonotonicTick();
+	if(_timerCount == 0)
+	{
+		_timerTick = now;
+	}
+	for(idx = 0; idx < _policyTable->kindCount; idx++)
+	{
+		int32_t timeout = _policyTable->kinds[idx].timeout;
+		if((resources & _policyTable->kinds[idx].mask) && (timeout > 0))
+		{
+			ReleaseTimer timer;
+			timer.app = app;
+			timer.resource = _policyTable->kinds[idx].mask;
+			timer.deadline = now + (uint64_t)((timeout + TIMERWHEEL_TICK - 1) / TIMERWHEEL_TICK);
+			_timerWheel[timer.deadline % TIMERWHEEL_SLOTS].push_back(timer);
+			_timerCount++;
+		}
+	}
+}
+
+static void ModeTimerExpire()
+{
+	if(_timerCount > 0)
+	{
+		uint64_t now = ModeMonotonicTick();
+		uint64_t steps = now - _timerTick;
+		uint64_t step;
+		if(steps > TIMERWHEEL_SLOTS)
+		{
+			steps = TIMERWHEEL_SLOTS;
+		}
+		/* only the slots passed since the last advance can hold due timers */
+		for(step = 1; step <= steps; step++)
+		{
+			std::vector<ReleaseTimer> *slot = &_timerWheel[(_timerTick + step) % TIMERWHEEL_SLOTS];
+			size_t idx = 0;
+			while(idx < slot->size())
+			{
+				if((*slot)[idx].deadline <= now)
+				{
+					_timerExpired.push_back((*slot)[idx]);
+					(*slot)[idx] = slot->back();
+					slot->pop_back();
+					_timerCount--;
+				}
+				else
+				{
+					idx++;
+				}
+			}
+		}
+		_timerTick = now;
+
+		std::vector<ReleaseTimer>::iterator iter;
+		for(iter = _timerExpired.begin(); iter != _timerExpired.end(); ++iter)
+		{
+			ModeReleaseTimeout(iter->app, iter->resource);
+		}
+		_timerExpired.clear();
+		ModeSignalFlush();
+	}
+}
+
+static void ModeTimerClear()
+{
+	if(_timerCount > 0)
+	{
+		uint32_t idx;
+		for(idx = 0; idx < TIMERWHEEL_SLOTS; idx++)
+		{
+			_timerWheel[idx].clear();
+		}
+		_timerCount = 0;
+	}
+}
+
+static int32_t ModeTimerNext()
+{
+	int32_t ret = -1;
+	if(_timerCount > 0)
+	{
+		uint64_t now = ModeMonotonicTick();
+		uint64_t next = _timerTick + TIMERWHEEL_SLOTS;
+		uint64_t step;
+		/* first slot holding a timer of this turn, else look again after one turn */
+		for(step = 1; step <= TIMERWHEEL_SLOTS; step++)
+		{
+			std::vector<ReleaseTimer> *slot = &_timerWheel[(_timerTick + step) % TIMERWHEEL_SLOTS];
+			std::vector<ReleaseTimer>::iterator iter;
+			for(iter = slot->begin(); iter != slot->end(); ++iter)
+			{
+				if(iter->deadline <= (_timerTick + step))
+				{
+					break;
+				}
+			}
+			if(iter != slot->end())
+			{
+				next = _timerTick + step;
+				break;
+			}
+		}
+		if(next > now)
+		{
+			ret = (int32_t)((next - now) * TIMERWHEEL_TICK);
+		}
+		else
+		{
+			ret = 0;
+		}
+	}
+	return ret;
+}
+
+static void ModeTimerArm()
+{
+	if(_ModeTimer != NULL)
+	{
+		int32_t wait = ModeTimerNext();
+		if(wait >= 0)
+		{
+			uint64_t tick = ModeMonotonicTick() + (uint64_t)(wait / TIMERWHEEL_TICK);
+			if((_timerArmed == 0) || (tick < _timerArmed))
+			{
+				_timerArmed = tick;
+				_ModeTimer(wait);
+			}
+		}
+	}
+}
+
+static void ModeReleaseTimeout(int32_t app, int32_t resource)
+{
+	int32_t pending = 0;
+	std::vector<ReleaseApp>::iterator iter;
+	for(iter = _relAppList.begin(); iter != _relAppList.end(); ++iter)
+	{
+		if(iter->app == app)
+		{
+			pending = iter->resource & resource;
+			break;
+		}
+	}
+	if(pending != 0)
+	{
+		uint32_t count;
+		pthread_mutex_lock(&_cmdMutex);
+		count = ++_releaseTimeouts[app];
+		_releaseTimeoutTotal++;
+		pthread_mutex_unlock(&_cmdMutex);
+		TCLog(TCLogLevelWarn, "%s : App(%d) did not release Resource(%d) in time, forced (%u timeouts)\n",
+			  __FUNCTION__, app, pending, count);
+		ModeRecordTrace(ModeTraceReleaseTimeout, MODE_NONE, app, pending, 0);
+		ModeProcessReleaseDone(pending, app);
+	}
+}
+
+static void ModeRecordTrace(int32_t event, int32_t mode, int32_t app, int32_t arg, uint64_t time)
+{
+	ModeTraceRecord record;
+	record.time = time;
+	record.event = (uint16_t)event;
+	record.app = (int16_t)app;
+	record.mode = mode;
+	record.arg = arg;
+	record.audio = ModeTraceDepth(_audio.size());
+	record.display = ModeTraceDepth(_display.size());
+	record.tuner = ModeTraceDepth(_tuner.size());
+	record.release = ModeTraceDepth(_relAppList.size());
+	record.audioDelta = (int8_t)(record.audio - _traceAudio);
+	record.displayDelta = (int8_t)(record.display - _traceDisplay);
+	record.tunerDelta = (int8_t)(record.tuner - _traceTuner);
+	record.releaseDelta = (int8_t)(record.release - _traceRelease);
+	_traceAudio = record.audio;
+	_traceDisplay = record.display;
+	_traceTuner = record.tuner;
+	_traceRelease = record.release;
+	ModeTraceAppend(&record);
+}
+
+static uint8_t ModeTraceDepth(size_t depth)
+{
+	return (depth > 0xFFU) ? (uint8_t)0xFFU : (uint8_t)depth;
+}
+
+static void ModeSignalChangedMode(const char *mode, int32_t app)
+{
+	ModeSignalPost(MODE_SIGNAL_CHANGED_MODE, mode, app, 0);
+}
+
+static void ModeSignalReleaseResource(int32_t resources, int32_t app)
+{
+	ModeSignalPost(MODE_SIGNAL_RELEASE_RESOURCE, "", app, resources);
+}
+
+static void ModeSignalEndedMode(const char *mode, int32_t app)
+{
+	ModeSignalPost(MODE_SIGNAL_ENDED_MODE, mode, app, 0);
+}
+
+static void ModeSignalSuspendMode(void)
+{
+	ModeSignalPost(MODE_SIGNAL_SUSPEND_MODE, "", -1, 0);
+}
+
+static void ModeSignalResumeMode(void)
+{
+	ModeSignalPost(MODE_SIGNAL_RESUME_MODE, "", -1, 0);
+}
+
+static void ModeSignalPost(int32_t event, const char *mode, int32_t app, int32_t resources)
+{
+	if(_signalBatch == MODE_SIGNAL_DIRECT)
+	{
+		ModeSignalSend(event, mode, app, resources);
+	}
+	else
+	{
+		PendingSignal pending;
+		pending.event = event;
+		pending.mode = mode;
+		pending.app = app;
+		pending.resources = resources;
+		pending.dropped = false;
+		_signalPending.push_back(pending);
+	}
+}
+
+/* traced as sent, so the trace shows what the apps saw */
+static void ModeSignalSend(int32_t event, const char *mode, int32_t app, int32_t resources)
+{
+	if(event == MODE_SIGNAL_CHANGED_MODE)
+	{
+		ModeRecordTrace(ModeTraceChangedMode, ModeFindName(mode), app, 0, 0);
+		_HostChangedMode(mode, app);
+	}
+	else if(event == MODE_SIGNAL_RELEASE_RESOURCE)
+	{
+		ModeRecordTrace(ModeTraceReleaseResource, MODE_NONE, app, resources, 0);
+		_HostReleaseResource(resources, app);
+	}
+	else if(event == MODE_SIGNAL_ENDED_MODE)
+	{
+		ModeRecordTrace(ModeTraceEndedMode, ModeFindName(mode), app, 0, 0);
+		_HostEndedMode(mode, app);
+	}
+	else if(event == MODE_SIGNAL_SUSPEND_MODE)
+	{
+		_HostSuspendMode();
+	}
+	else
+	{
+		_HostResumeMode();
+	}
+	__atomic_store_n(&_signalsSent, _signalsSent + 1U, __ATOMIC_RELAXED);
+}
+
+/*
+ * An app only keeps the last mode it was told, so a changed_mode is dropped when the next
+ * signal for the same app is another changed_mode, and any signal is dropped when it
+ * repeats the previous one for its app. suspend_mode and resume_mode are never dropped
+ * and nothing is coalesced across them.
+ */
+static void ModeSignalCoalesce()
+{
+	size_t idx;
+	size_t next;
+	for(idx = 0; idx < _signalPending.size(); idx++)
+	{
+		PendingSignal *signal = &_signalPending[idx];
+		if(signal->app >= 0)
+		{
+			for(next = idx + 1U; next < _signalPending.size(); next++)
+			{
+				const PendingSignal *later = &_signalPending[next];
+				if(later->app < 0)
+				{
+					break;
+				}
+				else if(later->app == signal->app)
+				{
+					if((later->event == MODE_SIGNAL_CHANGED_MODE) && (signal->event == MODE_SIGNAL_CHANGED_MODE))
+					{
+						signal->dropped = true;
+					}
+					else if((later->event == signal->event) && (later->resources == signal->resources) &&
+							(strcmp(later->mode, signal->mode) == 0))
+					{
+						signal->dropped = true;
+					}
+					else
+					{
+						/* told something else in between */
+					}
+					break;
+				}
+				else
+				{
+					/* another app */
+				}
+			}
+		}
+	}
+}
+
+static void ModeSignalFlush()
+{
+	if(!_signalPending.empty())
+	{
+		std::vector<PendingSignal>::const_iterator iter;
+		uint64_t coalesced = 0;
+		ModeSignalCoalesce();
+		if((_signalBatch == MODE_SIGNAL_TRANSITION) && (_HostTransition != NULL))
+		{
+			_signalTransition.clear();
+			for(iter = _signalPending.begin(); iter != _signalPending.end(); ++iter)
+			{
+				if(!iter->dropped)
+				{
+					ModeSignal signal;
+					signal.event = iter->event;
+					signal.mode = iter->mode;
+					signal.app = iter->app;
+					signal.resources = iter->resources;
+					_signalTransition.push_back(signal);
+					if(iter->event == MODE_SIGNAL_CHANGED_MODE)
+					{
+						ModeRecordTrace(ModeTraceChangedMode, ModeFindName(signal.mode), signal.app, 0, 0);
+					}
+					else if(iter->event == MODE_SIGNAL_RELEASE_RESOURCE)
+					{
+						ModeRecordTrace(ModeTraceReleaseResource, MODE_NONE, signal.app, signal.resources, 0);
+					}
+					else if(iter->event == MODE_SIGNAL_ENDED_MODE)
+					{
+						ModeRecordTrace(ModeTraceEndedMode, ModeFindName(signal.mode), signal.app, 0, 0);
+					}
+					else
+					{
+						/* suspend_mode and resume_mode are not traced as signals */
+					}
+				}
+				else
+				{
+					coalesced++;
+				}
 			}
-			_ChangedMode(_display.back().mode.c_str(), _display.back().app);
+			_HostTransition(_signalTransition.data(), (int32_t)_signalTransition.size());
+			__atomic_store_n(&_signalsSent, _signalsSent + _signalTransition.size(), __ATOMIC_RELAXED);
 		}
 		else
 		{
-			if(_display.back().full == 0)
+			for(iter = _signalPending.begin(); iter != _signalPending.end(); ++iter)
 			{
-				_ChangedMode("view", OSDAPP);
-			}
-			else
-			{
-				_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+				if(!iter->dropped)
+				{
+					ModeSignalSend(iter->event, iter->mode, iter->app, iter->resources);
+				}
+				else
+				{
+					coalesced++;
+				}
 			}
-			_ChangedMode(_display.back().mode.c_str(), _display.back().app);
 		}
+		if(coalesced > 0U)
+		{
+			TCLog(TCLogLevelDebug, "%s : %llu of %u signals superseded\n", __FUNCTION__,
+				  (unsigned long long)coalesced, (uint32_t)_signalPending.size());
+			__atomic_store_n(&_signalsCoalesced, _signalsCoalesced + coalesced, __ATOMIC_RELAXED);
+		}
+		_signalPending.clear();
 	}
-	else if(resumeAudio)
-	{
-		_ChangedMode(_audio.back().mode.c_str(), _audio.back().app);
-	}
-	else if(resumeDisplay)
+}
+
+static void ModeCountWakeup()
+{
+	time_t now = ModeMonotonicSecond();
+	if(now != _wakeupSecond)
 	{
-		if(_display.back().full == 0)
+		if(now == _wakeupSecond + 1)
 		{
-			_ChangedMode("view", OSDAPP);
+			_wakeupLastCount = _wakeupCount;
 		}
 		else
 		{
-			_ReleaseResource(RELEASEDISPLAY, OSDAPP);
+			_wakeupLastCount = 0;
 		}
-		_ChangedMode(_display.back().mode.c_str(), _display.back().app);
+		_wakeupSecond = now;
+		_wakeupCount = 0;
 	}
-
-	ModeAllResourcePrint();
-
-	ModeClearcmd();
-	_relAppList.clear();
-}
-
-static void ModeClearcmd()
-{
-	_cmdMode.mode.clear();
-	_cmdMode.app = -1;
-	_cmdMode.audio = -1;
-	_cmdMode.display = -1;
-	_cmdMode.resume = -1;
-	_cmdMode.mixing = -1;
+	_wakeupCount++;
+	_wakeupTotal++;
 }
 
 static void *ModeManagerThread(void *arg)
 {
+	(void)arg;
+	std::deque<ModeRequest> batch;
+	pthread_mutex_lock(&_cmdMutex);
 	while(_modemanagerStatus)
 	{
-		usleep(1000);
-
-		pthread_mutex_lock(&_cmdMutex);
-		if(!_cmdMode.mode.empty())
+		if(_cmdQueue.empty())
 		{
-			if(_cmdMode.state == 0)
-			{
-				ModeManagerResources();
-			}
-			else if(_cmdMode.state == 1)
-			{
-				ModeResume();
-			}
-			else if(_cmdMode.state == 2)
+			/* sleep until ModePostRequest() or ModeManagerRelease() signals or a release deadline is due */
+			int32_t wait = ModeTimerNext();
+			if(wait < 0)
 			{
-				ModeShutdown();
+				(void)pthread_cond_wait(&_cmdCond, &_cmdMutex);
 			}
 			else
 			{
-				TCLog(TCLogLevelDebug, "ModeManager Waiting\n");
+				struct timespec until;
+				(void)clock_gettime(CLOCK_MONOTONIC, &until);
+				until.tv_sec += wait / 1000;
+				until.tv_nsec += (long)(wait % 1000) * 1000000L;
+				if(until.tv_nsec >= 1000000000L)
+				{
+					until.tv_sec++;
+					until.tv_nsec -= 1000000000L;
+				}
+				(void)pthread_cond_timedwait(&_cmdCond, &_cmdMutex, &until);
 			}
+			ModeCountWakeup();
 		}
+		/* take every pending command at once so producers are not blocked while it runs */
+		batch.swap(_cmdQueue);
 		pthread_mutex_unlock(&_cmdMutex);
+
+		while(!batch.empty())
+		{
+			ModeProcessRequest(&batch.front());
+			batch.pop_front();
+		}
+		ModeTimerExpire();
+
+		pthread_mutex_lock(&_cmdMutex);
+	}
+	/* nobody will run what is still queued, release anyone waiting for it */
+	batch.swap(_cmdQueue);
+	pthread_mutex_unlock(&_cmdMutex);
+	while(!batch.empty())
+	{
+		if(batch.front().done != NULL)
+		{
+			batch.front().done(0, "", batch.front().app, NULL, 0, batch.front().user);
+		}
+		ModeReplyMerged(&batch.front(), 0, "", batch.front().app, NULL, 0);
+		batch.pop_front();
 	}
 	pthread_exit((void *)"Mode Manager thread exit\n");
 }
@@ -699,7 +2549,7 @@ static bool ModeCompareAudio(Resource mode)
 	{
 		if(!_audio.empty())
 		{
-			if(_audio.back().audio <= mode.audio)
+			if(_audio.back().level[KIND_AUDIO] <= mode.level[KIND_AUDIO])
 			{
 				if(!mode.mixing)
 				{
@@ -708,7 +2558,7 @@ static bool ModeCompareAudio(Resource mode)
 					{
 						if(riter->mixing)
 						{
-							if(riter->app != mode.app && riter->audio < mode.audio)
+							if(riter->app != mode.app && riter->level[KIND_AUDIO] < mode.level[KIND_AUDIO])
 							{
 								AddReleaseResources(riter->app, RELEASEAUDIO);
 							}
@@ -747,7 +2597,7 @@ static bool ModeCompareDisplay(Resource mode)
 	}
 	if(ret)
 	{
-		if(_display.empty() || _display.back().display <= mode.display)
+		if(_display.empty() || _display.back().level[KIND_DISPLAY] <= mode.level[KIND_DISPLAY])
 		{
 			if(!_display.empty())
 			{
@@ -768,22 +2618,24 @@ static bool ModeCompareDisplay(Resource mode)
 	return ret;
 }
 
-static bool ModeCompareTuner(Resource mode)
+static bool ModeCompareKind(uint32_t kind, const Resource *mode)
 {
 	bool ret = true;
-	int32_t releaseTuner = -1;
+	int32_t release = -1;
+	int32_t mask = _policyTable->kinds[kind].mask;
+	std::vector<Resource> &stack = _stacks[kind];
 	if(ret)
 	{
-		if(_tuner.empty() || _tuner.back().tuner <= mode.tuner)
+		if(stack.empty() || stack.back().level[kind] <= mode->level[kind])
 		{
-			if(!_tuner.empty())
+			if(!stack.empty())
 			{
-				AddReleaseResources(_tuner.back().app, RELEASETUNER);
-				releaseTuner = _tuner.back().app;
+				AddReleaseResources(stack.back().app, mask);
+				release = stack.back().app;
 			}
-			if(releaseTuner == mode.app)
+			if(release == mode->app)
 			{
-				RemoveReleaseResources(_tuner.back().app, RELEASETUNER);
+				RemoveReleaseResources(stack.back().app, mask);
 			}
 		}
 		else
@@ -791,9 +2643,105 @@ static bool ModeCompareTuner(Resource mode)
 			ret = false;
 		}
 	}
-	TCLog(TCLogLevelDebug, "%s : %d\n", __FUNCTION__, ret);
+	TCLog(TCLogLevelDebug, "%s : %s %d\n", __FUNCTION__, _policyTable->kinds[kind].name.c_str(), ret);
+	return ret;
+}
+
+template <uint32_t N> static uint32_t ModeKindCount()
+{
+	return (N != 0U) ? N : _policyTable->kindCount;
+}
+
+/* every kind the mode asks for is compared, so all the holders it displaces get released */
+template <uint32_t N> static bool ModeCompareKinds(const Resource *mode)
+{
+	bool ret = true;
+	uint32_t count = ModeKindCount<N>();
+	uint32_t kind;
+	for(kind = KIND_TUNER; kind < count; kind++)
+	{
+		if(mode->level[kind])
+		{
+			ret = ModeCompareKind(kind, mode) && ret;
+		}
+	}
 	return ret;
+}
+
+template <uint32_t N> static void ModeTakeKinds(const Resource *mode)
+{
+	uint32_t count = ModeKindCount<N>();
+	uint32_t kind;
+	for(kind = KIND_TUNER; kind < count; kind++)
+	{
+		if(mode->level[kind])
+		{
+			if(!mode->resume)
+			{
+				_stacks[kind].clear();
+			}
+			_stacks[kind].push_back(*mode);
+		}
+	}
+}
+
+template <uint32_t N> static void ModeKindsState()
+{
+	uint32_t count = ModeKindCount<N>();
+	uint32_t kind;
+	for(kind = KIND_TUNER; kind < count; kind++)
+	{
+		uint32_t depth = (uint32_t)_stacks[kind].size();
+		_decisionKey.append((const char *)&depth, sizeof(depth));
+		if(!_stacks[kind].empty())
+		{
+			ModeDecisionAppend(&_stacks[kind].back());
+		}
+	}
+}
+
+static void ModePublishKinds()
+{
+	_kinds = &_kindOps[(_policyTable->kindCount == KIND_BUILTIN) ? 0 : 1];
+}
 
+/* the top of every stack to the shared state page, if main() opened one */
+static void ModePublishState()
+{
+	ModeStateResource *resources = _publishHeld ? NULL : ModeStatePageBegin();
+	if(resources != NULL)
+	{
+		uint32_t kind;
+		for(kind = 0; kind < _policyTable->kindCount; kind++)
+		{
+			const std::vector<Resource> &stack = _stacks[kind];
+			ModeStateResource *entry = &resources[kind];
+			(void)strncpy(entry->resource, _policyTable->kinds[kind].name.c_str(), sizeof(entry->resource) - 1U);
+			entry->resource[sizeof(entry->resource) - 1U] = '\0';
+			entry->mask = _policyTable->kinds[kind].mask;
+			entry->depth = (uint32_t)stack.size();
+			if(!stack.empty())
+			{
+				(void)strncpy(entry->mode, ModeName(stack.back().mode), sizeof(entry->mode) - 1U);
+				entry->mode[sizeof(entry->mode) - 1U] = '\0';
+				entry->modeId = stack.back().mode;
+				entry->app = stack.back().app;
+				entry->full = stack.back().full;
+				entry->mixing = stack.back().mixing;
+				entry->resume = stack.back().resume;
+			}
+			else
+			{
+				entry->mode[0] = '\0';
+				entry->modeId = MODE_NONE;
+				entry->app = -1;
+				entry->full = 0;
+				entry->mixing = 0;
+				entry->resume = 0;
+			}
+		}
+		ModeStatePageCommit(_policyTable->kindCount);
+	}
 }
 
 static bool ModeExclusiveCheck(Resource mode)
@@ -831,37 +2779,34 @@ static void ModeManagerResources()
 	TCLog(TCLogLevelDebug, "%s\n", __FUNCTION__);
 	if(_cmdMode.resume)
 	{
-		if(_cmdMode.audio)
+		if(_cmdMode.level[KIND_AUDIO])
 		{
 			_audio.push_back(_cmdMode);
 		}
-		if(_cmdMode.display)
+		if(_cmdMode.level[KIND_DISPLAY])
 		{
 			_display.push_back(_cmdMode);
 		}
-		if(_cmdMode.tuner)
-		{
-			_tuner.push_back(_cmdMode);
-		}
+		_kinds->take(&_cmdMode);
 	}
 	else
 	{
-		if(_cmdMode.audio)
+		if(_cmdMode.level[KIND_AUDIO])
 		{
 			if(!_audio.empty())
 			{
 				if(_audio.back().mixing)
 				{
-					std::vector<Resource>::reverse_iterator riter;
-					for(riter = _audio.rbegin(); riter != _audio.rend();)
+					std::vector<Resource>::iterator iter;
+					for(iter = _audio.begin(); iter != _audio.end();)
 					{
-						if(riter->mixing)
+						if(iter->mixing)
 						{
-							++riter;
+							++iter;
 						}
 						else
 						{
-							_audio.erase(--riter.base());
+							iter = _audio.erase(iter);
 						}
 					}
 					_audio.insert(_audio.begin(), _cmdMode);
@@ -877,21 +2822,18 @@ static void ModeManagerResources()
 				_audio.push_back(_cmdMode);
 			}
 		}
-		if(_cmdMode.display)
+		if(_cmdMode.level[KIND_DISPLAY])
 		{
 			_display.clear();
 			_display.push_back(_cmdMode);
 		}
-		if(_cmdMode.tuner)
-		{
-			_tuner.clear();
-			_tuner.push_back(_cmdMode);
-		}
+		_kinds->take(&_cmdMode);
 	}
 	ModeChangeBackGround();
 	ModeRestoreBackGround();
 	ModeSendReleaseResource();
 	ModeAllResourcePrint();
+	ModePublishState();
 	ModeClearcmd();
 }
 
@@ -899,49 +2841,46 @@ static void ModeChangeBackGround(void)
 {
 	if(!_audio.empty() && !_display.empty())
 	{
-		int32_t audioPriority = _audio.back().audio;
-		int32_t audioIdx = _audio.size() - 1;
-		std::vector<Resource>::reverse_iterator riter;
-		for(riter = _audio.rbegin(); riter != _audio.rend(); ++riter)
+		int32_t audioPriority = _audio.back().level[KIND_AUDIO];
+		int32_t audioIdx;
+		/* walk down by index, entries are replaced or erased in place */
+		for(audioIdx = (int32_t)_audio.size() - 1; audioIdx >= 0; audioIdx--)
 		{
-			if(riter->audio < audioPriority)
+			Resource audio = _audio[audioIdx];
+			if(audio.level[KIND_AUDIO] < audioPriority)
 			{
 				break;
 			}
 			else
 			{
-				audioPriority = riter->audio;
-				if(riter->mode.find("bg") != -1)
+				audioPriority = audio.level[KIND_AUDIO];
+				if(ModePolicyForeground(audio.policy) >= 0)
 				{
 					TCLog(TCLogLevelDebug, "This Mode is already Background\n");
 				}
 				else
 				{
-					if(riter->app != _display.back().app && riter->display)
+					if(audio.app != _display.back().app && audio.level[KIND_DISPLAY])
 					{
 						Resource tmpMode;
-						std::string tmpstring = riter->mode;
-						tmpstring.append("bg");
-						tmpMode = ModeFindwithinPolicy(tmpstring.c_str(), riter->app);
-						if(!tmpMode.mode.empty())
+						tmpMode = ModePolicyResource(ModePolicyBackground(audio.policy));
+						if(tmpMode.mode != MODE_NONE)
 						{
-							_audio.erase(--riter.base());
-							_audio.insert(_audio.begin() + audioIdx, tmpMode);
-							_ChangedMode(tmpMode.mode.c_str(), tmpMode.app);
+							_audio[audioIdx] = tmpMode;
+							_ChangedMode(ModeName(tmpMode.mode), tmpMode.app);
 							TCLog(TCLogLevelDebug, "This Mode changed to Background\n");
 						}
 						else
 						{
-							AddReleaseResources(riter->app, RELEASEAUDIO);
+							AddReleaseResources(audio.app, RELEASEAUDIO);
 							if(!_display.back().resume)
 							{
-								_audio.erase(--riter.base());
+								_audio.erase(_audio.begin() + audioIdx);
 							}
 							TCLog(TCLogLevelDebug, "This Mode is not exist Background\n");
 						}
 					}
 				}
-				audioIdx--;
 			}
 		}
 	}
@@ -951,31 +2890,28 @@ static void ModeRestoreBackGround(void)
 {
 	if(!_audio.empty() && !_display.empty())
 	{
-		int32_t audioIdx = 0;
-		std::vector<Resource>::iterator iter;
-		for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+		uint32_t audioIdx;
+		for(audioIdx = 0; audioIdx < _audio.size(); audioIdx++)
 		{
-			if(iter->mode.find("bg") != -1)
+			Resource *audio = &_audio[audioIdx];
+			if(ModePolicyForeground(audio->policy) >= 0)
 			{
-				if(iter->app == _display.back().app)
+				if(audio->app == _display.back().app)
 				{
-					if(iter->audio >= _audio.back().audio)
+					if(audio->level[KIND_AUDIO] >= _audio.back().level[KIND_AUDIO])
 					{
 						Resource tmpMode;
-						iter->mode.erase(iter->mode.end()-2, iter->mode.end());
-						tmpMode = ModeFindwithinPolicy(iter->mode.c_str(), iter->app);
-						if(iter->resume == 0)
+						tmpMode = ModePolicyResource(ModePolicyForeground(audio->policy));
+						if(audio->resume == 0)
 						{
 							_display.pop_back();
 						}
-						_audio.erase(iter);
 						_display.push_back(tmpMode);
-						_audio.insert(_audio.begin() + audioIdx, tmpMode);
+						*audio = tmpMode;
 						TCLog(TCLogLevelDebug, "This Mode is restored\n");
 					}
 				}
 			}
-			audioIdx++;
 		}
 	}
 }
@@ -992,6 +2928,7 @@ static void ModeSendReleaseResource()
 		for(iter = _relAppList.begin(); iter != _relAppList.end(); ++iter)
 		{
 			_ReleaseResource(iter->resource, iter->app);
+			ModeTimerAdd(iter->app, iter->resource);
 		}
 	}
 	else
@@ -1000,51 +2937,358 @@ static void ModeSendReleaseResource()
 		{
 			_ReleaseResource(RELEASEDISPLAY, OSDAPP);
 		}
-		else if(_cmdMode.full == 0 && _cmdMode.display != 0)
+		else if(_cmdMode.full == 0 && _cmdMode.level[KIND_DISPLAY] != 0)
 		{
 			_ChangedMode("view", OSDAPP);
 		}
-		_ChangedMode(_cmdMode.mode.c_str(), _cmdMode.app);
-	}
-}
-
-static Resource ModeFindwithinPolicy(const char* mode, int32_t app)
-{
-	std::vector<Mode>::iterator iter;
-	Resource tmpResource;
-	for(iter = _policy.begin(); iter != _policy.end(); ++iter)
-	{
-		if((iter->app == app) && (strcmp(iter->mode, mode) == 0))
-		{
-			tmpResource.mode = iter->mode;
-			tmpResource.app = iter->app;
-			tmpResource.audio = iter->audio;
-			tmpResource.display = iter->display;
-			tmpResource.tuner = iter->tuner;
-			tmpResource.full = iter->full;
-			tmpResource.resume = iter->resume;
-			tmpResource.mixing = iter->mixing;
-			tmpResource.exclusive = iter->exclusive;
-			TCLog(TCLogLevelDebug, "mode: %s app: %d A=%d,D=%d,T=%d,F=%d,R=%d,M=%d,E=%d\n",
-					tmpResource.mode.c_str(),
-					tmpResource.app,
-					tmpResource.audio,
-					tmpResource.display,
-					tmpResource.tuner,
-					tmpResource.full,
-					tmpResource.resume,
-					tmpResource.mixing,
-					tmpResource.exclusive);
-			break;
+		_ChangedMode(ModeName(_cmdMode.mode), _cmdMode.app);
+	}
+}
+
+static Resource ModeFindwithinPolicy(int32_t mode, int32_t app)
+{
+	return ModePolicyResource(ModeFindPolicy(mode, app));
+}
+
+static int32_t ModeFindPolicy(int32_t mode, int32_t app)
+{
+	return ModeTableFindPolicy(_policyTable, mode, app);
+}
+
+static int32_t ModeTableFindPolicy(const PolicyTable *table, int32_t mode, int32_t app)
+{
+	int32_t index = -1;
+	if(mode != MODE_NONE)
+	{
+		std::unordered_map<uint64_t, uint32_t>::const_iterator found;
+		found = table->index.find(ModePolicyKey(mode, app));
+		if(found != table->index.end())
+		{
+			index = (int32_t)found->second;
 		}
 	}
+	return index;
+}
+
+/* policy index of the "bg" variant of a policy, -1 if none or the mode left the policy */
+static int32_t ModePolicyBackground(int32_t policy)
+{
+	return (policy >= 0) ? _policyTable->policy[policy].background : -1;
+}
+
+static int32_t ModePolicyForeground(int32_t policy)
+{
+	return (policy >= 0) ? _policyTable->policy[policy].foreground : -1;
+}
+
+static Resource ModePolicyResource(int32_t policy)
+{
+	Resource tmpResource = ModeNoneResource();
+	if(policy >= 0)
+	{
+		const Policy *entry = &_policyTable->policy[policy];
+		tmpResource.mode = entry->mode;
+		tmpResource.app = entry->app;
+		tmpResource.policy = policy;
+		(void)memcpy(tmpResource.level, entry->level, sizeof(tmpResource.level));
+		tmpResource.full = entry->full;
+		tmpResource.resume = entry->resume;
+		tmpResource.mixing = entry->mixing;
+		tmpResource.exclusive = entry->exclusive;
+		TCLog(TCLogLevelDebug, "mode: %s app: %d A=%d,D=%d,T=%d,F=%d,R=%d,M=%d,E=%d\n",
+				ModeName(tmpResource.mode),
+				tmpResource.app,
+				tmpResource.level[KIND_AUDIO],
+				tmpResource.level[KIND_DISPLAY],
+				tmpResource.level[KIND_TUNER],
+				tmpResource.full,
+				tmpResource.resume,
+				tmpResource.mixing,
+				tmpResource.exclusive);
+	}
 	return tmpResource;
 }
 
+static Resource ModeNoneResource()
+{
+	Resource none;
+	(void)memset(&none, 0, sizeof(Resource));
+	none.mode = MODE_NONE;
+	none.app = -1;
+	none.policy = -1;
+	return none;
+}
+
+static void ModeLinkBackGround(PolicyTable *table, int32_t policy)
+{
+	Policy *entry = &table->policy[policy];
+	const char *name = table->names[entry->mode].c_str();
+	size_t length = strlen(name);
+	char pair[sizeof(((Mode *)NULL)->mode) + 2];
+	int32_t other;
+
+	/* "<mode>bg" of the same app is the background variant of "<mode>" */
+	if((length > 2) && (strcmp(&name[length - 2], "bg") == 0))
+	{
+		(void)memcpy(pair, name, length - 2);
+		pair[length - 2] = '\0';
+		other = ModeTableFindPolicy(table, ModeTableFindName(table, pair), entry->app);
+		if(other >= 0)
+		{
+			entry->foreground = other;
+			table->policy[other].background = policy;
+		}
+	}
+	(void)snprintf(pair, sizeof(pair), "%sbg", name);
+	other = ModeTableFindPolicy(table, ModeTableFindName(table, pair), entry->app);
+	if(other >= 0)
+	{
+		entry->background = other;
+		table->policy[other].foreground = policy;
+	}
+}
+
+/* table setModePolicy() and setModeResource() fill, made on first use */
+static PolicyTable *ModeBuildTable()
+{
+	if(_buildTable == NULL)
+	{
+		const PolicyTable *current = __atomic_load_n(&_policyTable, __ATOMIC_ACQUIRE);
+		uint32_t kind;
+		_buildTable = new PolicyTable();
+		_buildTable->names = current->names;
+		_buildTable->ids = current->ids;
+		for(kind = 0; kind < KIND_BUILTIN; kind++)
+		{
+			_buildTable->kinds[kind].name = _builtinKinds[kind].name;
+			_buildTable->kinds[kind].mask = _builtinKinds[kind].resource;
+			_buildTable->kinds[kind].timeout = 0;
+		}
+		for(kind = KIND_BUILTIN; kind < current->kindCount; kind++)
+		{
+			_buildTable->kinds[kind].name = current->kinds[kind].name;
+			_buildTable->kinds[kind].mask = current->kinds[kind].mask;
+			_buildTable->kinds[kind].timeout = 0;
+		}
+		_buildTable->kindCount = (current->kindCount > KIND_BUILTIN) ? current->kindCount : KIND_BUILTIN;
+	}
+	return _buildTable;
+}
+
+static int32_t ModeTableFindKind(const PolicyTable *table, const char* resource)
+{
+	int32_t ret = -1;
+	uint32_t kind;
+	for(kind = 0; kind < table->kindCount; kind++)
+	{
+		if(strcmp(table->kinds[kind].name.c_str(), resource) == 0)
+		{
+			ret = (int32_t)kind;
+			break;
+		}
+	}
+	return ret;
+}
+
+static uint8_t ModePolicyLevel(const Mode *policy, const char* resource, int32_t level)
+{
+	uint8_t ret = (uint8_t)level;
+	if((level < 0) || (level > RESOURCE_LEVEL_MAX))
+	{
+		ret = (level < 0) ? 0U : (uint8_t)RESOURCE_LEVEL_MAX;
+		TCLog(TCLogLevelWarn, "%s : %s level %d of mode %s app %d is out of 0..%d, %u used\n", __FUNCTION__,
+			  resource, level, policy->mode, policy->app, RESOURCE_LEVEL_MAX, ret);
+	}
+	return ret;
+}
+
+/* a mask of 0 takes the lowest RELEASExxx bit no other kind uses */
+static int32_t ModeDeclareKind(PolicyTable *table, const char* resource, int32_t mask)
+{
+	int32_t ret = -1;
+	int32_t used = 0;
+	uint32_t kind;
+	for(kind = 0; kind < table->kindCount; kind++)
+	{
+		used |= table->kinds[kind].mask;
+	}
+	if(mask == 0)
+	{
+		mask = 1;
+		while(used & mask)
+		{
+			mask <<= 1;
+		}
+	}
+	if(table->kindCount >= RESOURCE_KINDS)
+	{
+		TCLog(TCLogLevelWarn, "%s : no room for resource %s, %d kinds at most\n", __FUNCTION__, resource, RESOURCE_KINDS);
+	}
+	else if(strlen(resource) >= MODE_RESOURCE_NAME_MAX)
+	{
+		TCLog(TCLogLevelWarn, "%s : resource name %s too long\n", __FUNCTION__, resource);
+	}
+	else if((mask <= 0) || ((mask & (mask - 1)) != 0) || (used & mask))
+	{
+		TCLog(TCLogLevelWarn, "%s : mask 0x%x of resource %s is not a free single bit\n", __FUNCTION__, mask, resource);
+	}
+	else
+	{
+		ret = (int32_t)table->kindCount;
+		table->kinds[ret].name = resource;
+		table->kinds[ret].mask = mask;
+		table->kinds[ret].timeout = 0;
+		table->kindCount++;
+		TCLog(TCLogLevelInfo, "%s : resource %s mask 0x%x\n", __FUNCTION__, resource, mask);
+	}
+	return ret;
+}
+
+static int32_t ModeInternName(PolicyTable *table, const char* mode)
+{
+	int32_t id = ModeTableFindName(table, mode);
+	if(id < 0)
+	{
+		id = (int32_t)table->names.size();
+		table->names.push_back(mode);
+		table->ids[table->names.back()] = id;
+		ModeTraceName(id, mode);
+	}
+	return id;
+}
+
+static int32_t ModeFindName(const char* mode)
+{
+	return ModeTableFindName(_policyTable, mode);
+}
+
+static int32_t ModeTableFindName(const PolicyTable *table, const char* mode)
+{
+	int32_t id = -1;
+	std::unordered_map<std::string, int32_t>::const_iterator found;
+	found = table->ids.find(mode);
+	if(found != table->ids.end())
+	{
+		id = found->second;
+	}
+	return id;
+}
+
+static const char *ModeName(int32_t mode)
+{
+	const char *name = "";
+	if((mode >= 0) && ((uint32_t)mode < _policyTable->names.size()))
+	{
+		name = _policyTable->names[mode].c_str();
+	}
+	return name;
+}
+
+static uint64_t ModePolicyKey(int32_t id, int32_t app)
+{
+	return ((uint64_t)(uint32_t)id << 32) | (uint64_t)(uint32_t)app;
+}
+
+/*
+ * Interns what ModeDecide() reads of the stacks : every audio entry, the app and the
+ * exclusive group of every display entry with the top one in full, and the top of every
+ * other kind.
+ */
+static uint32_t ModeDecisionState()
+{
+	if(_decisionDirty)
+	{
+		std::vector<Resource>::const_iterator iter;
+		std::unordered_map<std::string, uint32_t>::const_iterator found;
+		uint32_t depth;
+		_decisionKey.clear();
+		depth = (uint32_t)_audio.size();
+		_decisionKey.append((const char *)&depth, sizeof(depth));
+		for(iter = _audio.begin(); iter != _audio.end(); ++iter)
+		{
+			ModeDecisionAppend(&*iter);
+		}
+		depth = (uint32_t)_display.size();
+		_decisionKey.append((const char *)&depth, sizeof(depth));
+		for(iter = _display.begin(); iter != _display.end(); ++iter)
+		{
+			_decisionKey.append((const char *)&iter->app, sizeof(iter->app));
+			_decisionKey.append((const char *)&iter->exclusive, sizeof(iter->exclusive));
+		}
+		if(!_display.empty())
+		{
+			ModeDecisionAppend(&_display.back());
+		}
+		_kinds->state();
+		found = _decisionStateIds.find(_decisionKey);
+		if(found != _decisionStateIds.end())
+		{
+			_decisionState = found->second;
+		}
+		else
+		{
+			if(_decisionTables.size() >= DECISION_STATES)
+			{
+				ModeDecisionFlush();
+			}
+			_decisionState = (uint32_t)_decisionTables.size();
+			_decisionStateIds[_decisionKey] = _decisionState;
+			_decisionTables.push_back(DecisionMap());
+			__atomic_store_n(&_decisionStateCount, (uint32_t)_decisionTables.size(), __ATOMIC_RELAXED);
+		}
+		_decisionDirty = false;
+	}
+	return _decisionState;
+}
+
+static void ModeDecisionAppend(const Resource *resource)
+{
+	int32_t fields[4];
+	fields[0] = resource->mode;
+	fields[1] = resource->app;
+	fields[2] = resource->exclusive;
+	fields[3] = resource->mixing;
+	_decisionKey.append((const char *)fields, sizeof(fields));
+	_decisionKey.append((const char *)resource->level, sizeof(resource->level));
+}
+
+/* the policy changed or too many states were seen, decisions are learned again */
+static void ModeDecisionFlush()
+{
+	_decisionStateIds.clear();
+	_decisionTables.clear();
+	_decisionDirty = true;
+	__atomic_store_n(&_decisionStateCount, 0U, __ATOMIC_RELAXED);
+}
+
+static bool ModeDecisionEqual(const ModeDecision *a, const ModeDecision *b)
+{
+	bool ret = (a->result == b->result) && (a->compare == b->compare) && (a->compare.policy == b->compare.policy) &&
+			   (a->compare.state == b->compare.state) && (a->opCount == b->opCount);
+	uint32_t index;
+	for(index = 0; ret && (index < a->opCount) && (index < DECISION_OPS); index++)
+	{
+		ret = (a->ops[index].app == b->ops[index].app) && (a->ops[index].resource == b->ops[index].resource) &&
+			  (a->ops[index].remove == b->ops[index].remove);
+	}
+	return ret;
+}
+
 static void AddReleaseResources(int32_t app, int32_t resource)
 {
 	TCLog(TCLogLevelDebug, "%s : App(%d) Resource(%d)\n", __FUNCTION__, app, resource);
 	ReleaseApp relApp;
+	if(_decisionRecord != NULL)
+	{
+		if(_decisionRecord->opCount < DECISION_OPS)
+		{
+			DecisionOp *op = &_decisionRecord->ops[_decisionRecord->opCount];
+			op->app = app;
+			op->resource = resource;
+			op->remove = 0;
+		}
+		_decisionRecord->opCount++;
+	}
 	relApp.app = app;
 	relApp.resource = resource;
 
@@ -1073,6 +3317,17 @@ static void AddReleaseResources(int32_t app, int32_t resource)
 
 static void RemoveReleaseResources(int32_t app, int32_t resource)
 {
+	if(_decisionRecord != NULL)
+	{
+		if(_decisionRecord->opCount < DECISION_OPS)
+		{
+			DecisionOp *op = &_decisionRecord->ops[_decisionRecord->opCount];
+			op->app = app;
+			op->resource = resource;
+			op->remove = 1;
+		}
+		_decisionRecord->opCount++;
+	}
 	if(!_relAppList.empty())
 	{
 		TCLog(TCLogLevelDebug, "%s : App(%d) Resource(%d)\n", __FUNCTION__, app, resource);
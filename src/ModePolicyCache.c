@@ -0,0 +1,551 @@
+
+/****************************************************************************************
+ *   FileName    : ModePolicyCache.c
+ *   Description : Mode Policy Binary Cache C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "ModeManager.h"
+#include "ModePolicyCache.h"
+#include "ModeArray.h"
+
+#define NAME_HASH_MIN		64U		/* power of two */
+
+/* rows collected while parseDoc() runs between ModePolicyCacheBegin() and ModePolicyCacheEnd() */
+static int32_t s_collecting = 0;
+static ModePolicyCacheMode *s_modes = NULL;
+static uint32_t s_modeCount = 0;
+static uint32_t s_modeSize = 0;
+static ModePolicyCacheResource *s_resources = NULL;
+static uint32_t s_resourceCount = 0;
+static uint32_t s_resourceSize = 0;
+static ModePolicyCacheLevel *s_levels = NULL;
+static uint32_t s_levelCount = 0;
+static uint32_t s_levelSize = 0;
+
+/* string table, names are interned through an open addressing hash of offset + 1 */
+static char *s_strings = NULL;
+static uint32_t s_stringCount = 0;
+static uint32_t s_stringSize = 0;
+static uint32_t *s_nameHash = NULL;
+static uint32_t s_nameHashSize = 0;
+static uint32_t s_nameCount = 0;
+static int32_t s_failed = 0;
+
+static uint32_t ModePolicyCacheFnv(const void *data, size_t size, uint32_t hash);
+static uint32_t ModePolicyCacheIntern(const char *name);
+static int32_t ModePolicyCacheGrowHash(void);
+static int32_t ModePolicyCacheStat(const char *source, uint64_t *time, uint64_t *size);
+
+void ModePolicyCacheBegin(void)
+{
+	ModePolicyCacheEnd();
+	s_collecting = 1;
+}
+
+void ModePolicyCacheAddMode(const Mode *mode)
+{
+	if((s_collecting != 0) && (s_failed == 0))
+	{
+		ModePolicyCacheMode *modes = (ModePolicyCacheMode *)ModeArrayGrow(s_modes, &s_modeSize, s_modeCount,
+																		   sizeof(ModePolicyCacheMode));
+		uint32_t index;
+		if(modes != NULL)
+		{
+			ModePolicyCacheMode *record = &modes[s_modeCount];
+			s_modes = modes;
+			record->name = ModePolicyCacheIntern(mode->mode);
+			record->app = mode->app;
+			record->audio = mode->audio;
+			record->display = mode->display;
+			record->tuner = mode->tuner;
+			record->full = mode->full;
+			record->resume = mode->resume;
+			record->mixing = mode->mixing;
+			record->exclusive = mode->exclusive;
+			record->levelFirst = s_levelCount;
+			record->levelCount = 0;
+			s_modeCount++;
+			for(index = 0; (index < mode->resourceCount) && (s_failed == 0); index++)
+			{
+				ModePolicyCacheLevel *levels = (ModePolicyCacheLevel *)ModeArrayGrow(s_levels, &s_levelSize, s_levelCount,
+																					 sizeof(ModePolicyCacheLevel));
+				if(levels != NULL)
+				{
+					s_levels = levels;
+					s_levels[s_levelCount].name = ModePolicyCacheIntern(mode->resources[index].name);
+					s_levels[s_levelCount].level = mode->resources[index].level;
+					s_levelCount++;
+					record->levelCount++;
+				}
+				else
+				{
+					s_failed = 1;
+				}
+			}
+		}
+		else
+		{
+			s_failed = 1;
+		}
+	}
+}
+
+void ModePolicyCacheAddResource(const char *name, int32_t mask, int32_t timeout)
+{
+	if((s_collecting != 0) && (s_failed == 0))
+	{
+		ModePolicyCacheResource *resources = (ModePolicyCacheResource *)ModeArrayGrow(s_resources, &s_resourceSize,
+																					  s_resourceCount,
+																					  sizeof(ModePolicyCacheResource));
+		if(resources != NULL)
+		{
+			s_resources = resources;
+			s_resources[s_resourceCount].name = ModePolicyCacheIntern(name);
+			s_resources[s_resourceCount].mask = mask;
+			s_resources[s_resourceCount].timeout = timeout;
+			s_resourceCount++;
+		}
+		else
+		{
+			s_failed = 1;
+		}
+	}
+}
+
+int32_t ModePolicyCacheWrite(const char *path, const char *const *sources, uint32_t count)
+{
+	int32_t ret = 0;
+	ModePolicyCacheHeader header;
+	ModePolicyCacheSource *records = (ModePolicyCacheSource *)calloc((count > 0U) ? count : 1U, sizeof(ModePolicyCacheSource));
+	char temp[256];
+	int32_t fd = -1;
+	uint32_t index;
+
+	(void)memset(&header, 0, sizeof(header));
+	if((s_collecting == 0) || (records == NULL))
+	{
+		ret = -1;
+	}
+	for(index = 0; (ret == 0) && (index < count); index++)
+	{
+		if(ModePolicyCacheStat(sources[index], &records[index].time, &records[index].size) == 0)
+		{
+			records[index].path = ModePolicyCacheIntern(sources[index]);
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		if(s_failed != 0)
+		{
+			TCLog(TCLogLevelWarn, "%s : out of memory\n", __FUNCTION__);
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		(void)memcpy(header.magic, MODE_POLICY_CACHE_MAGIC, sizeof(MODE_POLICY_CACHE_MAGIC));
+		header.version = MODE_POLICY_CACHE_VERSION;
+		header.headerSize = (uint32_t)sizeof(ModePolicyCacheHeader);
+		header.modeSize = (uint32_t)sizeof(ModePolicyCacheMode);
+		header.resourceSize = (uint32_t)sizeof(ModePolicyCacheResource);
+		header.modeCount = s_modeCount;
+		header.resourceCount = s_resourceCount;
+		header.stringSize = s_stringCount;
+		header.sourceSize = (uint32_t)sizeof(ModePolicyCacheSource);
+		header.sourceCount = count;
+		header.levelSize = (uint32_t)sizeof(ModePolicyCacheLevel);
+		header.levelCount = s_levelCount;
+		header.checksum = ModePolicyCacheFnv(records, count * sizeof(ModePolicyCacheSource), 2166136261U);
+		header.checksum = ModePolicyCacheFnv(s_modes, s_modeCount * sizeof(ModePolicyCacheMode), header.checksum);
+		header.checksum = ModePolicyCacheFnv(s_levels, s_levelCount * sizeof(ModePolicyCacheLevel), header.checksum);
+		header.checksum = ModePolicyCacheFnv(s_resources, s_resourceCount * sizeof(ModePolicyCacheResource), header.checksum);
+		header.checksum = ModePolicyCacheFnv(s_strings, s_stringCount, header.checksum);
+
+		/* written aside and renamed, a reader never sees half a cache */
+		if(snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int32_t)sizeof(temp))
+		{
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0)
+		{
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		if((write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) ||
+		   (write(fd, records, count * sizeof(ModePolicyCacheSource)) != (ssize_t)(count * sizeof(ModePolicyCacheSource))) ||
+		   (write(fd, s_modes, s_modeCount * sizeof(ModePolicyCacheMode)) != (ssize_t)(s_modeCount * sizeof(ModePolicyCacheMode))) ||
+		   (write(fd, s_levels, s_levelCount * sizeof(ModePolicyCacheLevel)) != (ssize_t)(s_levelCount * sizeof(ModePolicyCacheLevel))) ||
+		   (write(fd, s_resources, s_resourceCount * sizeof(ModePolicyCacheResource)) != (ssize_t)(s_resourceCount * sizeof(ModePolicyCacheResource))) ||
+		   (write(fd, s_strings, s_stringCount) != (ssize_t)s_stringCount))
+		{
+			ret = -1;
+		}
+		if(close(fd) != 0)
+		{
+			ret = -1;
+		}
+		if((ret == 0) && (rename(temp, path) != 0))
+		{
+			ret = -1;
+		}
+		if(ret != 0)
+		{
+			(void)unlink(temp);
+		}
+	}
+	if(ret == 0)
+	{
+		TCLog(TCLogLevelInfo, "%s : %u modes, %u resources from %u files to %s\n", __FUNCTION__,
+			  s_modeCount, s_resourceCount, count, path);
+	}
+	else
+	{
+		TCLog(TCLogLevelWarn, "%s : can not write %s\n", __FUNCTION__, path);
+	}
+	free(records);
+	return ret;
+}
+
+void ModePolicyCacheEnd(void)
+{
+	free(s_modes);
+	free(s_resources);
+	free(s_levels);
+	free(s_strings);
+	free(s_nameHash);
+	s_modes = NULL;
+	s_modeCount = 0;
+	s_modeSize = 0;
+	s_resources = NULL;
+	s_resourceCount = 0;
+	s_resourceSize = 0;
+	s_levels = NULL;
+	s_levelCount = 0;
+	s_levelSize = 0;
+	s_strings = NULL;
+	s_stringCount = 0;
+	s_stringSize = 0;
+	s_nameHash = NULL;
+	s_nameHashSize = 0;
+	s_nameCount = 0;
+	s_failed = 0;
+	s_collecting = 0;
+}
+
+/*
+ * Maps the cache and feeds it to setModeResource() and setModePolicy() as
+ * parseDoc() would. Nothing is applied unless the whole file checks out, so on -1
+ * the caller can still fall back to the XML.
+ */
+int32_t ModePolicyCacheLoad(const char *path, const char *const *sources, uint32_t count)
+{
+	int32_t ret = 0;
+	const char *reason = NULL;
+	int32_t fd = open(path, O_RDONLY);
+	struct stat info;
+	void *map = MAP_FAILED;
+	size_t size = 0;
+	const ModePolicyCacheHeader *header = NULL;
+	const ModePolicyCacheSource *records = NULL;
+	const ModePolicyCacheMode *modes = NULL;
+	const ModePolicyCacheLevel *levels = NULL;
+	const ModePolicyCacheResource *resources = NULL;
+	const char *strings = NULL;
+	uint64_t sourceTime = 0;
+	uint64_t sourceSize = 0;
+	uint32_t index;
+
+	if((fd < 0) || (fstat(fd, &info) != 0))
+	{
+		reason = "missing";
+		ret = -1;
+	}
+	else if((size_t)info.st_size < sizeof(ModePolicyCacheHeader))
+	{
+		reason = "truncated";
+		ret = -1;
+	}
+	else
+	{
+		size = (size_t)info.st_size;
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			reason = "not mapped";
+			ret = -1;
+		}
+	}
+	if(fd >= 0)
+	{
+		(void)close(fd);
+	}
+
+	if(ret == 0)
+	{
+		header = (const ModePolicyCacheHeader *)map;
+		records = (const ModePolicyCacheSource *)&header[1];
+		if((memcmp(header->magic, MODE_POLICY_CACHE_MAGIC, sizeof(MODE_POLICY_CACHE_MAGIC)) != 0) ||
+		   (header->version != MODE_POLICY_CACHE_VERSION) ||
+		   (header->headerSize != sizeof(ModePolicyCacheHeader)) ||
+		   (header->modeSize != sizeof(ModePolicyCacheMode)) ||
+		   (header->resourceSize != sizeof(ModePolicyCacheResource)) ||
+		   (header->sourceSize != sizeof(ModePolicyCacheSource)) ||
+		   (header->levelSize != sizeof(ModePolicyCacheLevel)))
+		{
+			reason = "other version";
+			ret = -1;
+		}
+		else if(((uint64_t)header->sourceCount * sizeof(ModePolicyCacheSource)) +
+				((uint64_t)header->modeCount * sizeof(ModePolicyCacheMode)) +
+				((uint64_t)header->levelCount * sizeof(ModePolicyCacheLevel)) +
+				((uint64_t)header->resourceCount * sizeof(ModePolicyCacheResource)) +
+				(uint64_t)header->stringSize + sizeof(ModePolicyCacheHeader) != (uint64_t)size)
+		{
+			reason = "truncated";
+			ret = -1;
+		}
+		else
+		{
+			modes = (const ModePolicyCacheMode *)&records[header->sourceCount];
+			levels = (const ModePolicyCacheLevel *)&modes[header->modeCount];
+			resources = (const ModePolicyCacheResource *)&levels[header->levelCount];
+			strings = (const char *)&resources[header->resourceCount];
+			if((header->stringSize == 0U) || (strings[header->stringSize - 1U] != '\0') ||
+			   (header->checksum != ModePolicyCacheFnv(records, size - sizeof(ModePolicyCacheHeader), 2166136261U)))
+			{
+				reason = "corrupted";
+				ret = -1;
+			}
+		}
+	}
+	for(index = 0; (ret == 0) && (index < header->modeCount); index++)
+	{
+		if((modes[index].name >= header->stringSize) || (modes[index].levelFirst > header->levelCount) ||
+		   (modes[index].levelCount > header->levelCount - modes[index].levelFirst) ||
+		   (modes[index].levelCount > (sizeof(((Mode *)NULL)->resources) / sizeof(((Mode *)NULL)->resources[0]))))
+		{
+			reason = "corrupted";
+			ret = -1;
+		}
+	}
+	for(index = 0; (ret == 0) && (index < header->levelCount); index++)
+	{
+		if((levels[index].name >= header->stringSize) ||
+		   (strlen(&strings[levels[index].name]) >= MODE_RESOURCE_NAME_MAX))
+		{
+			reason = "corrupted";
+			ret = -1;
+		}
+	}
+	for(index = 0; (ret == 0) && (index < header->resourceCount); index++)
+	{
+		if(resources[index].name >= header->stringSize)
+		{
+			reason = "corrupted";
+			ret = -1;
+		}
+	}
+	if((ret == 0) && (header->sourceCount != count))
+	{
+		reason = "stale";
+		ret = -1;
+	}
+	for(index = 0; (ret == 0) && (index < count); index++)
+	{
+		if((records[index].path >= header->stringSize) || (strcmp(&strings[records[index].path], sources[index]) != 0) ||
+		   (ModePolicyCacheStat(sources[index], &sourceTime, &sourceSize) != 0) ||
+		   (records[index].time != sourceTime) || (records[index].size != sourceSize))
+		{
+			reason = "stale";
+			ret = -1;
+		}
+	}
+
+	if(ret == 0)
+	{
+		Mode configMode;
+		uint32_t level;
+		for(index = 0; index < header->resourceCount; index++)
+		{
+			(void)setModeResource(&strings[resources[index].name], resources[index].mask, resources[index].timeout);
+		}
+		for(index = 0; index < header->modeCount; index++)
+		{
+			(void)memset(&configMode, 0, sizeof(Mode));
+			(void)strncpy(configMode.mode, &strings[modes[index].name], sizeof(configMode.mode) - 1U);
+			configMode.app = modes[index].app;
+			configMode.audio = modes[index].audio;
+			configMode.display = modes[index].display;
+			configMode.tuner = modes[index].tuner;
+			configMode.full = modes[index].full;
+			configMode.resume = modes[index].resume;
+			configMode.mixing = modes[index].mixing;
+			configMode.exclusive = modes[index].exclusive;
+			for(level = 0; level < modes[index].levelCount; level++)
+			{
+				const ModePolicyCacheLevel *record = &levels[modes[index].levelFirst + level];
+				(void)strcpy(configMode.resources[level].name, &strings[record->name]);
+				configMode.resources[level].level = record->level;
+			}
+			configMode.resourceCount = modes[index].levelCount;
+			setModePolicy(configMode);
+		}
+		TCLog(TCLogLevelInfo, "%s : %u modes, %u resources from %s\n", __FUNCTION__,
+			  header->modeCount, header->resourceCount, path);
+	}
+	else
+	{
+		TCLog(TCLogLevelInfo, "%s : %s is %s\n", __FUNCTION__, path, reason);
+	}
+	if(map != MAP_FAILED)
+	{
+		(void)munmap(map, size);
+	}
+	return ret;
+}
+
+static uint32_t ModePolicyCacheFnv(const void *data, size_t size, uint32_t hash)
+{
+	const uint8_t *byte = (const uint8_t *)data;
+	size_t index;
+	for(index = 0; index < size; index++)
+	{
+		hash ^= byte[index];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static uint32_t ModePolicyCacheIntern(const char *name)
+{
+	uint32_t ret = 0;
+	uint32_t length = (uint32_t)strlen(name) + 1U;
+	uint32_t slot = 0;
+	uint32_t mask;
+	int32_t found = 0;
+
+	if((s_nameCount * 2U >= s_nameHashSize) && (ModePolicyCacheGrowHash() != 0))
+	{
+		s_failed = 1;
+	}
+	if(s_failed == 0)
+	{
+		mask = s_nameHashSize - 1U;
+		slot = ModePolicyCacheFnv(name, length, 2166136261U) & mask;
+		while((found == 0) && (s_nameHash[slot] != 0U))
+		{
+			if(strcmp(&s_strings[s_nameHash[slot] - 1U], name) == 0)
+			{
+				ret = s_nameHash[slot] - 1U;
+				found = 1;
+			}
+			else
+			{
+				slot = (slot + 1U) & mask;
+			}
+		}
+	}
+	if((s_failed == 0) && (found == 0))
+	{
+		char *strings = (char *)ModeArrayGrow(s_strings, &s_stringSize, s_stringCount + length - 1U, 1U);
+		if(strings != NULL)
+		{
+			s_strings = strings;
+			ret = s_stringCount;
+			(void)memcpy(&s_strings[s_stringCount], name, length);
+			s_stringCount += length;
+			s_nameHash[slot] = ret + 1U;
+			s_nameCount++;
+		}
+		else
+		{
+			s_failed = 1;
+		}
+	}
+	return ret;
+}
+
+static int32_t ModePolicyCacheGrowHash(void)
+{
+	int32_t ret = 0;
+	uint32_t size = (s_nameHashSize == 0U) ? NAME_HASH_MIN : (s_nameHashSize * 2U);
+	uint32_t *hash = (uint32_t *)calloc(size, sizeof(uint32_t));
+	uint32_t index;
+	if(hash != NULL)
+	{
+		for(index = 0; index < s_nameHashSize; index++)
+		{
+			if(s_nameHash[index] != 0U)
+			{
+				const char *name = &s_strings[s_nameHash[index] - 1U];
+				uint32_t slot = ModePolicyCacheFnv(name, strlen(name) + 1U, 2166136261U) & (size - 1U);
+				while(hash[slot] != 0U)
+				{
+					slot = (slot + 1U) & (size - 1U);
+				}
+				hash[slot] = s_nameHash[index];
+			}
+		}
+		free(s_nameHash);
+		s_nameHash = hash;
+		s_nameHashSize = size;
+	}
+	else
+	{
+		ret = -1;
+	}
+	return ret;
+}
+
+static int32_t ModePolicyCacheStat(const char *source, uint64_t *time, uint64_t *size)
+{
+	int32_t ret = -1;
+	struct stat info;
+	if(stat(source, &info) == 0)
+	{
+		*time = ((uint64_t)info.st_mtim.tv_sec * 1000000000U) + (uint64_t)info.st_mtim.tv_nsec;
+		*size = (uint64_t)info.st_size;
+		ret = 0;
+	}
+	return ret;
+}
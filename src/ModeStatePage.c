@@ -0,0 +1,151 @@
+/****************************************************************************************
+ *   FileName    : ModeStatePage.c
+ *   Description : Mode Shared State Page
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "ModeManager.h"
+#include "ModeStatePage.h"
+
+#if (MODE_STATE_PAGE_KINDS != MODE_RESOURCE_KINDS_MAX) || (MODE_STATE_PAGE_RESOURCE != MODE_RESOURCE_NAME_MAX)
+#error "ModeStatePage.h does not match the resource kinds of ModeManager.h"
+#endif
+
+/*
+ * The page is only written by whoever arbitrates, the manager thread or the DBus thread
+ * with inline arbitration, one at a time. ModeStatePageBegin() makes seq odd, the caller
+ * fills the resources in place and ModeStatePageCommit() makes seq even again.
+ */
+static ModeStatePage *s_page = NULL;
+static uint32_t s_seq = 0;
+
+int32_t ModeStatePageOpen(const char *path)
+{
+	int32_t ret = 0;
+	char temp[256];
+	int32_t fd = -1;
+	void *map = MAP_FAILED;
+
+	ModeStatePageClose();
+	/* set up aside and renamed, a client never attaches to half a page */
+	if(snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int32_t)sizeof(temp))
+	{
+		ret = -1;
+	}
+	if(ret == 0)
+	{
+		fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if((fd < 0) || (ftruncate(fd, (off_t)sizeof(ModeStatePage)) != 0))
+		{
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		map = mmap(NULL, sizeof(ModeStatePage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		ModeStatePage *page = (ModeStatePage *)map;
+		(void)memcpy(page->magic, MODE_STATE_PAGE_MAGIC, sizeof(MODE_STATE_PAGE_MAGIC));
+		page->version = MODE_STATE_PAGE_VERSION;
+		page->size = (uint32_t)sizeof(ModeStatePage);
+		if(rename(temp, path) == 0)
+		{
+			s_page = page;
+			s_seq = 0;
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	if(fd >= 0)
+	{
+		(void)close(fd);
+	}
+	if(ret == 0)
+	{
+		TCLog(TCLogLevelInfo, "%s : %s\n", __FUNCTION__, path);
+	}
+	else
+	{
+		if(map != MAP_FAILED)
+		{
+			(void)munmap(map, sizeof(ModeStatePage));
+		}
+		(void)unlink(temp);
+		TCLog(TCLogLevelWarn, "%s : can not publish %s\n", __FUNCTION__, path);
+	}
+	return ret;
+}
+
+/* the resources to fill, NULL if no page is published */
+ModeStateResource *ModeStatePageBegin(void)
+{
+	ModeStateResource *ret = NULL;
+	if(s_page != NULL)
+	{
+		s_seq++;
+		/* acquire keeps the caller's stores to the page after seq turns odd */
+		(void)__atomic_exchange_n(&s_page->seq, s_seq, __ATOMIC_ACQ_REL);
+		ret = s_page->resources;
+	}
+	return ret;
+}
+
+void ModeStatePageCommit(uint32_t count)
+{
+	if(s_page != NULL)
+	{
+		s_page->count = (count < MODE_STATE_PAGE_KINDS) ? count : MODE_STATE_PAGE_KINDS;
+		s_page->generation++;
+		s_seq++;
+		__atomic_store_n(&s_page->seq, s_seq, __ATOMIC_RELEASE);
+	}
+}
+
+void ModeStatePageClose(void)
+{
+	if(s_page != NULL)
+	{
+		(void)ModeStatePageBegin();
+		s_page->closed = 1;
+		ModeStatePageCommit(s_page->count);
+		(void)munmap(s_page, sizeof(ModeStatePage));
+		s_page = NULL;
+	}
+}
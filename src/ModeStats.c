@@ -0,0 +1,238 @@
+
+/****************************************************************************************
+ *   FileName    : ModeStats.c
+ *   Description : Mode Latency Statistics C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "TCLog.h"
+#include "ModeStats.h"
+#include "ModeManager.h"
+
+/*
+ * Log-linear histograms: values below 8 nsec get a bucket each, above that every power
+ * of two is split into 8 buckets, so a bucket is at most 12.5% wide. Samples are added
+ * with relaxed atomics from any thread, readers see a slightly torn but usable view.
+ */
+#define STATS_SUB_BITS		3
+#define STATS_SUB_COUNT		(1U << STATS_SUB_BITS)
+#define STATS_MAX_MSB		47		/* about 39 hours in nsec, longer samples share the last bucket */
+#define STATS_BUCKETS		(((STATS_MAX_MSB - STATS_SUB_BITS) + 2) * STATS_SUB_COUNT)
+#define STATS_APPS_MAX		32
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t max;
+	uint64_t bucket[STATS_BUCKETS];
+} ModeStatsHistogram;
+
+const char *g_modeStatsMethodNames[TotalModeStatsMethod] = {
+	"change_mode",
+	"end_mode",
+	"release_resource_done",
+	"suspend",
+	"resume",
+	"change_modes"
+};
+
+const char *g_modeStatsStageNames[TotalModeStatsStage] = {
+	"dispatch",
+	"queue",
+	"run",
+	"resources",
+	"total"
+};
+
+static ModeStatsHistogram s_histogram[TotalModeStatsMethod][TotalModeStatsStage];
+
+static uint32_t ModeStatsBucket(uint64_t nsec);
+static uint64_t ModeStatsBucketLimit(uint32_t bucket);
+static uint64_t ModeStatsPercentile(const uint64_t *bucket, uint64_t count, uint64_t max, uint32_t percent);
+
+uint64_t ModeStatsNow(void)
+{
+	struct timespec now;
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+void ModeStatsRecord(int32_t method, int32_t stage, uint64_t nsec)
+{
+	if((method >= 0) && (method < (int32_t)TotalModeStatsMethod) &&
+	   (stage >= 0) && (stage < (int32_t)TotalModeStatsStage))
+	{
+		ModeStatsHistogram *histogram = &s_histogram[method][stage];
+		uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+		(void)__atomic_fetch_add(&histogram->bucket[ModeStatsBucket(nsec)], 1U, __ATOMIC_RELAXED);
+		(void)__atomic_fetch_add(&histogram->count, 1U, __ATOMIC_RELAXED);
+		while((nsec > max) &&
+			  !__atomic_compare_exchange_n(&histogram->max, &max, nsec, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+		}
+	}
+}
+
+void ModeStatsSummarize(int32_t method, int32_t stage, ModeStatsSummary *summary)
+{
+	if((summary != NULL) && (method >= 0) && (method < (int32_t)TotalModeStatsMethod) &&
+	   (stage >= 0) && (stage < (int32_t)TotalModeStatsStage))
+	{
+		uint64_t bucket[STATS_BUCKETS];
+		const ModeStatsHistogram *histogram = &s_histogram[method][stage];
+		uint64_t count = 0;
+		uint32_t index;
+		/* sum the copy rather than trusting count, writers may be half way through */
+		for(index = 0; index < STATS_BUCKETS; index++)
+		{
+			bucket[index] = __atomic_load_n(&histogram->bucket[index], __ATOMIC_RELAXED);
+			count += bucket[index];
+		}
+		summary->count = count;
+		summary->max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+		summary->p50 = ModeStatsPercentile(bucket, count, summary->max, 50);
+		summary->p90 = ModeStatsPercentile(bucket, count, summary->max, 90);
+		summary->p99 = ModeStatsPercentile(bucket, count, summary->max, 99);
+	}
+}
+
+void ModeStatsDump(void)
+{
+	uint32_t method;
+	uint32_t stage;
+	ModeStatsSummary summary;
+	ModeManagerStats stats;
+	ModeAppCounter counters[STATS_APPS_MAX];
+	ModeAppCoalesce coalesced[STATS_APPS_MAX];
+	int32_t count;
+	int32_t index;
+
+	TCLog(TCLogLevelInfo, "[STATS]%-22s %-9s %10s %10s %10s %10s %10s (nsec)\n",
+		  "method", "stage", "count", "p50", "p90", "p99", "max");
+	for(method = 0; method < (uint32_t)TotalModeStatsMethod; method++)
+	{
+		for(stage = 0; stage < (uint32_t)TotalModeStatsStage; stage++)
+		{
+			ModeStatsSummarize((int32_t)method, (int32_t)stage, &summary);
+			if(summary.count != 0U)
+			{
+				TCLog(TCLogLevelInfo, "[STATS]%-22s %-9s %10llu %10llu %10llu %10llu %10llu\n",
+					  g_modeStatsMethodNames[method], g_modeStatsStageNames[stage],
+					  (unsigned long long)summary.count, (unsigned long long)summary.p50,
+					  (unsigned long long)summary.p90, (unsigned long long)summary.p99,
+					  (unsigned long long)summary.max);
+			}
+		}
+	}
+
+	getModeManagerStats(&stats);
+	TCLog(TCLogLevelInfo, "[STATS]wakeups %llu (%u/s) queue %u high water %u dropped %llu release timeouts %llu\n",
+		  (unsigned long long)stats.wakeups, stats.wakeupsPerSec, stats.queueDepth, stats.queueHighWater,
+		  (unsigned long long)stats.queueDropped, (unsigned long long)stats.releaseTimeouts);
+	TCLog(TCLogLevelInfo, "[STATS]decision cache hits %llu misses %llu mismatches %llu states %u\n",
+		  (unsigned long long)stats.decisionHits, (unsigned long long)stats.decisionMisses,
+		  (unsigned long long)stats.decisionMismatches, stats.decisionStates);
+	TCLog(TCLogLevelInfo, "[STATS]signals sent %llu coalesced %llu\n",
+		  (unsigned long long)stats.signalsSent, (unsigned long long)stats.signalsCoalesced);
+	TCLog(TCLogLevelInfo, "[STATS]change_mode superseded %llu merged %llu\n",
+		  (unsigned long long)stats.requestsSuperseded, (unsigned long long)stats.requestsMerged);
+	count = getModeReleaseTimeouts(counters, STATS_APPS_MAX);
+	for(index = 0; index < count; index++)
+	{
+		TCLog(TCLogLevelInfo, "[STATS]app %d release timeouts %u\n", counters[index].app, counters[index].count);
+	}
+	count = getModeCoalescedRequests(coalesced, STATS_APPS_MAX);
+	for(index = 0; index < count; index++)
+	{
+		TCLog(TCLogLevelInfo, "[STATS]app %d change_mode superseded %u merged %u\n",
+			  coalesced[index].app, coalesced[index].superseded, coalesced[index].merged);
+	}
+}
+
+static uint32_t ModeStatsBucket(uint64_t nsec)
+{
+	uint32_t ret;
+	if(nsec < STATS_SUB_COUNT)
+	{
+		ret = (uint32_t)nsec;
+	}
+	else
+	{
+		uint32_t msb = 63U - (uint32_t)__builtin_clzll(nsec);
+		if(msb > STATS_MAX_MSB)
+		{
+			ret = STATS_BUCKETS - 1U;
+		}
+		else
+		{
+			ret = ((msb - STATS_SUB_BITS + 1U) * STATS_SUB_COUNT) +
+				  (uint32_t)((nsec >> (msb - STATS_SUB_BITS)) & (STATS_SUB_COUNT - 1U));
+		}
+	}
+	return ret;
+}
+
+static uint64_t ModeStatsBucketLimit(uint32_t bucket)
+{
+	uint64_t ret;
+	if(bucket < STATS_SUB_COUNT)
+	{
+		ret = bucket;
+	}
+	else
+	{
+		uint32_t shift = (bucket / STATS_SUB_COUNT) - 1U;
+		uint64_t low = (uint64_t)(STATS_SUB_COUNT + (bucket % STATS_SUB_COUNT)) << shift;
+		ret = low + ((uint64_t)1 << shift) - 1U;
+	}
+	return ret;
+}
+
+static uint64_t ModeStatsPercentile(const uint64_t *bucket, uint64_t count, uint64_t max, uint32_t percent)
+{
+	uint64_t ret = 0;
+	if(count != 0U)
+	{
+		uint64_t rank = ((count * percent) + 99U) / 100U;
+		uint64_t seen = 0;
+		uint32_t index;
+		for(index = 0; index < STATS_BUCKETS; index++)
+		{
+			seen += bucket[index];
+			if(seen >= rank)
+			{
+				ret = ModeStatsBucketLimit(index);
+				break;
+			}
+		}
+		if(ret > max)
+		{
+			ret = max;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,253 @@
+
+/****************************************************************************************
+ *   FileName    : ModeTrace.c
+ *   Description : Mode Flight Recorder C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "ModeTrace.h"
+
+#define TRACE_MASK			(MODE_TRACE_RECORDS - 1U)
+
+/*
+ * Fixed ring of records. Writers take a slot with an atomic increment and publish it by
+ * storing its sequence number last, a slot whose sequence is 0 or changes while it is
+ * copied is being rewritten and is left out of the dump. The fields are copied with
+ * atomic accesses, the seq exchange and the acquire loads order them without fences.
+ */
+static ModeTraceRecord s_ring[MODE_TRACE_RECORDS];
+static uint32_t s_next = 0;
+
+/* mode id -> name, filled while the policy is loaded */
+static char **s_names = NULL;
+static uint32_t s_nameCount = 0;
+static uint32_t s_nameSize = 0;
+static pthread_mutex_t s_nameMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t ModeTraceClock(clockid_t clock);
+static void ModeTraceCopy(ModeTraceRecord *to, const ModeTraceRecord *from, int32_t order);
+
+void ModeTraceAppend(ModeTraceRecord *record)
+{
+	uint32_t seq = __atomic_add_fetch(&s_next, 1U, __ATOMIC_RELAXED);
+	ModeTraceRecord *slot = &s_ring[(seq - 1U) & TRACE_MASK];
+	if(seq == 0U)
+	{
+		/* 0 marks a slot being written, skip it on wrap */
+		seq = __atomic_add_fetch(&s_next, 1U, __ATOMIC_RELAXED);
+		slot = &s_ring[(seq - 1U) & TRACE_MASK];
+	}
+	if(record->time == 0U)
+	{
+		record->time = ModeTraceClock(CLOCK_MONOTONIC);
+	}
+	record->seq = seq;
+	/* acquire keeps the field stores after the slot is marked */
+	(void)__atomic_exchange_n(&slot->seq, 0U, __ATOMIC_ACQ_REL);
+	ModeTraceCopy(slot, record, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+}
+
+void ModeTraceName(int32_t id, const char *name)
+{
+	if((id >= 0) && (name != NULL))
+	{
+		pthread_mutex_lock(&s_nameMutex);
+		if((uint32_t)id >= s_nameSize)
+		{
+			uint32_t size = (s_nameSize == 0U) ? 64U : s_nameSize;
+			char **names;
+			while(size <= (uint32_t)id)
+			{
+				size *= 2U;
+			}
+			names = (char **)realloc(s_names, size * sizeof(char *));
+			if(names != NULL)
+			{
+				(void)memset(&names[s_nameSize], 0, (size - s_nameSize) * sizeof(char *));
+				s_names = names;
+				s_nameSize = size;
+			}
+		}
+		if(((uint32_t)id < s_nameSize) && (s_names[id] == NULL))
+		{
+			s_names[id] = strdup(name);
+			if((uint32_t)id >= s_nameCount)
+			{
+				s_nameCount = (uint32_t)id + 1U;
+			}
+		}
+		pthread_mutex_unlock(&s_nameMutex);
+	}
+}
+
+int32_t ModeTraceDump(const char *path)
+{
+	int32_t ret = -1;
+	char temp[256];
+	FILE *fp = NULL;
+	int32_t fd = -1;
+
+	/*
+	 * written aside and renamed like the policy cache. The temp file is created fresh and
+	 * never through a link, a planted symlink can not redirect the dump.
+	 */
+	if(strcmp(path, MODE_TRACE_FILE) == 0)
+	{
+		(void)mkdir(MODE_TRACE_DIR, 0700);
+	}
+	if(snprintf(temp, sizeof(temp), "%s.tmp", path) < (int32_t)sizeof(temp))
+	{
+		(void)unlink(temp);
+		fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	}
+	if(fd >= 0)
+	{
+		fp = fdopen(fd, "wb");
+		if(fp == NULL)
+		{
+			(void)close(fd);
+			(void)unlink(temp);
+		}
+	}
+	if(fp != NULL)
+	{
+		static ModeTraceRecord records[MODE_TRACE_RECORDS];
+		static pthread_mutex_t dumpMutex = PTHREAD_MUTEX_INITIALIZER;
+		ModeTraceHeader header;
+		uint32_t next;
+		uint32_t first;
+		uint32_t seq;
+		uint32_t count = 0;
+		uint32_t index;
+
+		pthread_mutex_lock(&dumpMutex);
+		next = __atomic_load_n(&s_next, __ATOMIC_ACQUIRE);
+		first = next - MODE_TRACE_RECORDS;
+		for(seq = first + 1U; seq != (next + 1U); seq++)
+		{
+			const ModeTraceRecord *slot = &s_ring[(seq - 1U) & TRACE_MASK];
+			if((seq != 0U) && (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq))
+			{
+				/* acquire keeps the field loads before the second seq load */
+				ModeTraceCopy(&records[count], slot, __ATOMIC_ACQUIRE);
+				records[count].seq = seq;
+				if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+				{
+					count++;
+				}
+			}
+		}
+
+		(void)memset(&header, 0, sizeof(header));
+		(void)memcpy(header.magic, MODE_TRACE_MAGIC, sizeof(MODE_TRACE_MAGIC));
+		header.version = MODE_TRACE_VERSION;
+		header.recordSize = (uint32_t)sizeof(ModeTraceRecord);
+		header.recordCount = count;
+		header.monotonicTime = ModeTraceClock(CLOCK_MONOTONIC);
+		header.realTime = ModeTraceClock(CLOCK_REALTIME);
+
+		pthread_mutex_lock(&s_nameMutex);
+		header.nameCount = s_nameCount;
+		ret = (fwrite(&header, sizeof(header), 1, fp) == 1U) ? 0 : -1;
+		for(index = 0; (index < s_nameCount) && (ret == 0); index++)
+		{
+			const char *name = (s_names[index] != NULL) ? s_names[index] : "";
+			uint16_t length = (uint16_t)strlen(name);
+			if((fwrite(&length, sizeof(length), 1, fp) != 1U) ||
+			   (fwrite(name, 1, length, fp) != length))
+			{
+				ret = -1;
+			}
+		}
+		pthread_mutex_unlock(&s_nameMutex);
+
+		if((ret == 0) && (count > 0U) && (fwrite(records, sizeof(ModeTraceRecord), count, fp) != count))
+		{
+			ret = -1;
+		}
+		pthread_mutex_unlock(&dumpMutex);
+
+		if(fclose(fp) != 0)
+		{
+			ret = -1;
+		}
+		if((ret == 0) && (rename(temp, path) != 0))
+		{
+			ret = -1;
+		}
+		if(ret != 0)
+		{
+			(void)unlink(temp);
+		}
+		if(ret == 0)
+		{
+			TCLog(TCLogLevelInfo, "%s : %u events to %s\n", __FUNCTION__, count, path);
+		}
+		else
+		{
+			TCLog(TCLogLevelError, "%s : writing %s failed\n", __FUNCTION__, path);
+		}
+	}
+	else
+	{
+		TCLog(TCLogLevelError, "%s : can not open %s\n", __FUNCTION__, path);
+	}
+	return ret;
+}
+
+static uint64_t ModeTraceClock(clockid_t clock)
+{
+	struct timespec now;
+	(void)clock_gettime(clock, &now);
+	return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+/* every field but seq, loaded with order and stored relaxed */
+static void ModeTraceCopy(ModeTraceRecord *to, const ModeTraceRecord *from, int32_t order)
+{
+	__atomic_store_n(&to->time, __atomic_load_n(&from->time, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->event, __atomic_load_n(&from->event, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->app, __atomic_load_n(&from->app, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->mode, __atomic_load_n(&from->mode, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->arg, __atomic_load_n(&from->arg, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->audio, __atomic_load_n(&from->audio, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->display, __atomic_load_n(&from->display, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->tuner, __atomic_load_n(&from->tuner, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->release, __atomic_load_n(&from->release, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->audioDelta, __atomic_load_n(&from->audioDelta, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->displayDelta, __atomic_load_n(&from->displayDelta, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->tunerDelta, __atomic_load_n(&from->tunerDelta, order), __ATOMIC_RELAXED);
+	__atomic_store_n(&to->releaseDelta, __atomic_load_n(&from->releaseDelta, order), __ATOMIC_RELAXED);
+}
@@ -28,130 +28,734 @@ between Telechips and Company.
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 
 #include "TCLog.h"
 #include "ModeXMLParser.h"
 #include "ModeManager.h"
+#include "ModeArray.h"
+#include "ModePolicyCache.h"
+#include "ModeStats.h"
 
+#define MODE_PARSE_THREADS			4
 
-int32_t parseDoc(const char *docname)
+/* integer <mode> attributes, matched by the reader's interned name */
+typedef struct
 {
-	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
-	int32_t ret = 0;
-	xmlDocPtr doc;
-	xmlNodePtr cur;
+	const char *name;
+	size_t offset;				/* int32_t within Mode */
+} ModeAttribute;
 
-	doc = xmlParseFile(docname);
+static const ModeAttribute s_modeAttributes[] = {
+	{"app", offsetof(Mode, app)},
+	{"audio", offsetof(Mode, audio)},
+	{"display", offsetof(Mode, display)},
+	{"tuner", offsetof(Mode, tuner)},
+	{"full", offsetof(Mode, full)},
+	{"resume", offsetof(Mode, resume)},
+	{"mixing", offsetof(Mode, mixing)},
+	{"exclusive", offsetof(Mode, exclusive)}
+};
 
-	if(doc == NULL)
+#define MODE_ATTRIBUTES		(sizeof(s_modeAttributes) / sizeof(s_modeAttributes[0]))
+
+/* element and attribute names interned in the reader's dictionary, compared by pointer */
+typedef struct
+{
+	const xmlChar *policies;
+	const xmlChar *mode;
+	const xmlChar *resource;
+	const xmlChar *name;
+	const xmlChar *timeout;
+	const xmlChar *mask;
+	const xmlChar *attributes[MODE_ATTRIBUTES];
+} ModeReaderNames;
+
+/* where a file's rows go as they are read, applied right away or kept for a merge */
+typedef struct
+{
+	void (*mode)(const Mode *configMode, void *user);
+	void (*resource)(const char *name, int32_t mask, int32_t timeout, void *user);
+	void *user;
+} ModeParseSink;
+
+typedef struct
+{
+	char name[MODE_RESOURCE_NAME_MAX];
+	int32_t mask;
+	int32_t timeout;
+} ModeParsedResource;
+
+/* one file of a policy set and the rows it parsed to */
+typedef struct
+{
+	char *path;
+	Mode *modes;
+	uint32_t modeCount;
+	uint32_t modeSize;
+	ModeParsedResource *resources;
+	uint32_t resourceCount;
+	uint32_t resourceSize;
+	int32_t failed;
+	int32_t ret;
+	uint64_t usec;
+} ModePolicyFile;
+
+/* the base policy in files[0], then the overlays in name order */
+typedef struct
+{
+	ModePolicyFile *files;
+	uint32_t count;
+	uint32_t next;				/* next file for a parse worker */
+} ModePolicySet;
+
+static int32_t ParseFile(const char *docname, const ModeParseSink *sink);
+static void ParseModeElement(xmlTextReaderPtr reader, const ModeReaderNames *names, const ModeParseSink *sink);
+static void ParseResourceElement(xmlTextReaderPtr reader, const ModeReaderNames *names, const ModeParseSink *sink);
+static void ParseModeResource(Mode *configMode, const char *resource, int32_t level);
+static void ParsedMode(const Mode *configMode, void *user);
+static void ParsedResource(const char *name, int32_t mask, int32_t timeout, void *user);
+static int32_t PolicySetOpen(ModePolicySet *set, const char *docname, const char *overlaydir);
+static void PolicySetClose(ModePolicySet *set);
+static int32_t OverlayFilter(const struct dirent *entry);
+static int32_t PolicySetParse(ModePolicySet *set);
+static void *PolicySetWorker(void *arg);
+static void CollectMode(const Mode *configMode, void *user);
+static void CollectResource(const char *name, int32_t mask, int32_t timeout, void *user);
+static int32_t PolicySetMerge(const ModePolicySet *set);
+static uint32_t PolicyKeyHash(const char *name, int32_t app);
+
+/*
+ * Streams the document through an xmlTextReader into rows, no tree is kept. The rows are
+ * applied once the document ended, resources first as on every other load path, so a
+ * <resource> may come after the modes that name it.
+ */
+int32_t parseDoc(const char *docname)
+{
+	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
+	int32_t ret;
+	ModePolicyFile file;
+	ModeParseSink sink;
+	uint32_t row;
+	(void)memset(&file, 0, sizeof(ModePolicyFile));
+	file.path = (char *)docname;
+	sink.mode = CollectMode;
+	sink.resource = CollectResource;
+	sink.user = &file;
+	ret = ParseFile(docname, &sink);
+	if((ret == 0) && (file.failed != 0))
 	{
-		TCLog(TCLogLevelError, "[PARSER]Document not parsed successfully. \n");
+		TCLog(TCLogLevelError, "%s : out of memory for %s\n", __FUNCTION__, docname);
 		ret = -1;
 	}
-	if(ret != -1)
+	if(ret == 0)
 	{
-		cur = xmlDocGetRootElement(doc);
-		if(cur == NULL)
+		for(row = 0; row < file.resourceCount; row++)
 		{
-			TCLog(TCLogLevelError, "[PARSER]empty document\n");
-			xmlFreeDoc(doc);
-			ret = -1;
+			ParsedResource(file.resources[row].name, file.resources[row].mask, file.resources[row].timeout, NULL);
+		}
+		for(row = 0; row < file.modeCount; row++)
+		{
+			ParsedMode(&file.modes[row], NULL);
 		}
 	}
-	if(ret != -1)
+	free(file.modes);
+	free(file.resources);
+	return ret;
+}
+
+static int32_t ParseFile(const char *docname, const ModeParseSink *sink)
+{
+	int32_t ret = 0;
+	int32_t status = 0;
+	int32_t root = 0;
+	uint32_t index;
+	ModeReaderNames names = {0};
+	xmlTextReaderPtr reader = xmlReaderForFile(docname, NULL, XML_PARSE_NONET);
+
+	if(reader == NULL)
+	{
+		TCLog(TCLogLevelError, "[PARSER]Document not parsed successfully. \n");
+		ret = -1;
+	}
+	else
 	{
-		if(xmlStrcmp((cur->name), (const xmlChar *)"policies") != 0)
+		names.policies = xmlTextReaderConstString(reader, (const xmlChar *)"policies");
+		names.mode = xmlTextReaderConstString(reader, (const xmlChar *)"mode");
+		names.resource = xmlTextReaderConstString(reader, (const xmlChar *)"resource");
+		names.name = xmlTextReaderConstString(reader, (const xmlChar *)"name");
+		names.timeout = xmlTextReaderConstString(reader, (const xmlChar *)"timeout");
+		names.mask = xmlTextReaderConstString(reader, (const xmlChar *)"mask");
+		for(index = 0; index < MODE_ATTRIBUTES; index++)
 		{
-			TCLog(TCLogLevelError, "[PARSER]document of the wrong type, root node != policies");
-			xmlFreeDoc(doc);
-			ret = -1;
+			names.attributes[index] = xmlTextReaderConstString(reader, (const xmlChar *)s_modeAttributes[index].name);
 		}
 	}
-	if(ret != -1)
+	while((ret == 0) && ((status = xmlTextReaderRead(reader)) == 1))
 	{
-		cur = cur->xmlChildrenNode;
-		Mode configMode;
-		xmlChar *key;
-		while (cur != NULL)
+		if(xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
 		{
-			(void)memset(&configMode, 0, sizeof(Mode));
-			if (xmlStrcmp(cur->name, (const xmlChar *)"mode") == 0)
+			const xmlChar *element = xmlTextReaderConstLocalName(reader);
+			int32_t depth = xmlTextReaderDepth(reader);
+			if(depth == 0)
 			{
-				key = xmlGetProp(cur, (const xmlChar *)"name");
-				if(key != NULL)
-				{
-					(void)strncpy(configMode.mode,(char*)key, (uint32_t)xmlStrlen(key));
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"app");
-				if(key != NULL)
-				{
-					configMode.app = atoi((char*)key);
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"audio");
-				if(key != NULL)
-				{
-					configMode.audio = atoi((char*)key);
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"display");
-				if(key != NULL)
-				{
-					configMode.display = atoi((char*)key);
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"tuner");
-				if(key != NULL)
-				{
-					configMode.tuner = atoi((char*)key);
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"full");
-				if(key != NULL)
+				if(element == names.policies)
 				{
-					configMode.full = atoi((char*)key);
-					xmlFree(key);
+					root = 1;
 				}
-				key = xmlGetProp(cur, (const xmlChar *)"resume");
-				if(key != NULL)
+				else
 				{
-					configMode.resume = atoi((char*)key);
-					xmlFree(key);
+					TCLog(TCLogLevelError, "[PARSER]document of the wrong type, root node != policies");
+					ret = -1;
 				}
-				key = xmlGetProp(cur, (const xmlChar *)"mixing");
-				if(key != NULL)
-				{
-					configMode.mixing = atoi((char*)key);
-					xmlFree(key);
-				}
-				key = xmlGetProp(cur, (const xmlChar *)"exclusive");
-				if(key != NULL)
-				{
-					configMode.exclusive = atoi((char*)key);
-					xmlFree(key);
-				}
-				setModePolicy(configMode);
-			    TCLog(TCLogLevelInfo, "[PARSER]mode: %s app: %d audio: %d display: %d  tuner : %d  full : %d resume: %d mixing: %d exclusive: %d\n",
-						configMode.mode,
-						configMode.app,
-						configMode.audio,
-						configMode.display,
-						configMode.tuner,
-						configMode.full,
-						configMode.resume,
-						configMode.mixing,
-						configMode.exclusive);
 			}
-			cur = cur->next;
+			else if((depth == 1) && (element == names.mode))
+			{
+				ParseModeElement(reader, &names, sink);
+			}
+			else if((depth == 1) && (element == names.resource))
+			{
+				ParseResourceElement(reader, &names, sink);
+			}
+			else
+			{
+				/* not ours */
+			}
 		}
 	}
-	xmlFreeDoc(doc);
+	if((ret == 0) && (status < 0))
+	{
+		TCLog(TCLogLevelError, "[PARSER]Document not parsed successfully. \n");
+		ret = -1;
+	}
+	if((ret == 0) && (root == 0))
+	{
+		TCLog(TCLogLevelError, "[PARSER]empty document\n");
+		ret = -1;
+	}
+	if(reader != NULL)
+	{
+		xmlFreeTextReader(reader);
+	}
 	if(ret != 0)
 	{
 		TCLog(TCLogLevelError, "[PARSER]Config File Parsing Failed\n");
 	}
 	return ret;
 }
+
+int32_t parseDocCached(const char *docname, const char *cachename)
+{
+	return parseDocSet(docname, NULL, cachename);
+}
+
+/*
+ * Loads docname with the *.xml files of overlaydir on top, in name order. A later file
+ * overrides the (name, app) modes and the resources an earlier one set, new modes go
+ * after the base ones. The files are parsed in parallel, each into rows of its own,
+ * then merged on this thread and applied in one pass. overlaydir may be missing, and
+ * cachename NULL to parse the XML every time.
+ */
+int32_t parseDocSet(const char *docname, const char *overlaydir, const char *cachename)
+{
+	TCLog(TCLogLevelInfo, "%s\n", __FUNCTION__);
+	int32_t ret;
+	int32_t cached = -1;
+	ModePolicySet set;
+	const char **sources = NULL;
+	uint32_t index;
+
+	ret = PolicySetOpen(&set, docname, overlaydir);
+	if(ret == 0)
+	{
+		sources = (const char **)calloc(set.count, sizeof(const char *));
+		if(sources == NULL)
+		{
+			ret = -1;
+		}
+	}
+	if((ret == 0) && (cachename != NULL))
+	{
+		for(index = 0; index < set.count; index++)
+		{
+			sources[index] = set.files[index].path;
+		}
+		cached = ModePolicyCacheLoad(cachename, sources, set.count);
+	}
+	if((ret == 0) && (cached != 0))
+	{
+		/* missing or stale, parse the XML and compile it for the next start */
+		if(cachename != NULL)
+		{
+			ModePolicyCacheBegin();
+		}
+		if(set.count == 1U)
+		{
+			/* nothing to merge */
+			uint64_t start = ModeStatsNow();
+			ret = parseDoc(docname);
+			TCLog(TCLogLevelInfo, "%s : %s parsed in %llu usec\n", __FUNCTION__, docname,
+				  (unsigned long long)((ModeStatsNow() - start) / 1000U));
+		}
+		else
+		{
+			ret = PolicySetParse(&set);
+			if(ret == 0)
+			{
+				ret = PolicySetMerge(&set);
+			}
+		}
+		if((ret == 0) && (cachename != NULL))
+		{
+			(void)ModePolicyCacheWrite(cachename, sources, set.count);
+		}
+		if(cachename != NULL)
+		{
+			ModePolicyCacheEnd();
+		}
+	}
+	free(sources);
+	PolicySetClose(&set);
+	return ret;
+}
+
+static void ParseModeElement(xmlTextReaderPtr reader, const ModeReaderNames *names, const ModeParseSink *sink)
+{
+	Mode configMode;
+	uint32_t index;
+	(void)memset(&configMode, 0, sizeof(Mode));
+	while(xmlTextReaderMoveToNextAttribute(reader) == 1)
+	{
+		const xmlChar *attribute = xmlTextReaderConstLocalName(reader);
+		const char *value = (const char *)xmlTextReaderConstValue(reader);
+		if(value == NULL)
+		{
+			/* no value to take */
+		}
+		else if(attribute == names->name)
+		{
+			(void)strncpy(configMode.mode, value, sizeof(configMode.mode) - 1U);
+		}
+		else
+		{
+			for(index = 0; index < MODE_ATTRIBUTES; index++)
+			{
+				if(attribute == names->attributes[index])
+				{
+					*(int32_t *)((char *)&configMode + s_modeAttributes[index].offset) = atoi(value);
+					break;
+				}
+			}
+			if(index == MODE_ATTRIBUTES)
+			{
+				ParseModeResource(&configMode, (const char *)attribute, atoi(value));
+			}
+		}
+	}
+	(void)xmlTextReaderMoveToElement(reader);
+	sink->mode(&configMode, sink->user);
+}
+
+/* any other attribute names the level of a resource declared with <resource> */
+static void ParseModeResource(Mode *configMode, const char *resource, int32_t level)
+{
+	if(level == 0)
+	{
+		/* not used, nothing to keep */
+	}
+	else if((configMode->resourceCount >= (sizeof(configMode->resources) / sizeof(configMode->resources[0]))) ||
+			(strlen(resource) >= MODE_RESOURCE_NAME_MAX))
+	{
+		TCLog(TCLogLevelWarn, "[PARSER]resource %s of mode %s ignored\n", resource, configMode->mode);
+	}
+	else
+	{
+		(void)strcpy(configMode->resources[configMode->resourceCount].name, resource);
+		configMode->resources[configMode->resourceCount].level = level;
+		configMode->resourceCount++;
+	}
+}
+
+static void ParseResourceElement(xmlTextReaderPtr reader, const ModeReaderNames *names, const ModeParseSink *sink)
+{
+	xmlChar *name = NULL;
+	xmlChar *timeout = NULL;
+	int32_t mask = 0;
+	while(xmlTextReaderMoveToNextAttribute(reader) == 1)
+	{
+		const xmlChar *attribute = xmlTextReaderConstLocalName(reader);
+		if((attribute == names->name) && (name == NULL))
+		{
+			name = xmlTextReaderValue(reader);
+		}
+		else if((attribute == names->timeout) && (timeout == NULL))
+		{
+			timeout = xmlTextReaderValue(reader);
+		}
+		else if((attribute == names->mask) && (xmlTextReaderConstValue(reader) != NULL))
+		{
+			/* RELEASExxx bit, 0x20 style */
+			mask = (int32_t)strtol((const char *)xmlTextReaderConstValue(reader), NULL, 0);
+		}
+		else
+		{
+			/* not ours */
+		}
+	}
+	(void)xmlTextReaderMoveToElement(reader);
+	if(name != NULL)
+	{
+		sink->resource((char*)name, mask, (timeout != NULL) ? atoi((char*)timeout) : 0, sink->user);
+	}
+	if(name != NULL)
+	{
+		xmlFree(name);
+	}
+	if(timeout != NULL)
+	{
+		xmlFree(timeout);
+	}
+}
+
+static void ParsedMode(const Mode *configMode, void *user)
+{
+	(void)user;
+	setModePolicy(*configMode);
+	ModePolicyCacheAddMode(configMode);
+	TCLog(TCLogLevelDebug, "[PARSER]mode: %s app: %d audio: %d display: %d  tuner : %d  full : %d resume: %d mixing: %d exclusive: %d\n",
+		  configMode->mode,
+		  configMode->app,
+		  configMode->audio,
+		  configMode->display,
+		  configMode->tuner,
+		  configMode->full,
+		  configMode->resume,
+		  configMode->mixing,
+		  configMode->exclusive);
+}
+
+static void ParsedResource(const char *name, int32_t mask, int32_t timeout, void *user)
+{
+	(void)user;
+	(void)setModeResource(name, mask, timeout);
+	ModePolicyCacheAddResource(name, mask, timeout);
+	TCLog(TCLogLevelDebug, "[PARSER]resource: %s mask: 0x%x timeout: %d\n", name, mask, timeout);
+}
+
+
+static int32_t PolicySetOpen(ModePolicySet *set, const char *docname, const char *overlaydir)
+{
+	int32_t ret = 0;
+	struct dirent **list = NULL;
+	int32_t count = 0;
+	int32_t index;
+
+	(void)memset(set, 0, sizeof(ModePolicySet));
+	if(overlaydir != NULL)
+	{
+		count = scandir(overlaydir, &list, OverlayFilter, alphasort);
+		if(count < 0)
+		{
+			if(errno != ENOENT)
+			{
+				TCLog(TCLogLevelError, "%s : can not read %s\n", __FUNCTION__, overlaydir);
+				ret = -1;
+			}
+			count = 0;
+		}
+	}
+	if(ret == 0)
+	{
+		set->files = (ModePolicyFile *)calloc((size_t)count + 1U, sizeof(ModePolicyFile));
+		if(set->files != NULL)
+		{
+			set->files[0].path = strdup(docname);
+			set->count = 1;
+			ret = (set->files[0].path != NULL) ? 0 : -1;
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	for(index = 0; (ret == 0) && (index < count); index++)
+	{
+		size_t length = strlen(overlaydir) + strlen(list[index]->d_name) + 2U;
+		char *path = (char *)malloc(length);
+		if(path != NULL)
+		{
+			(void)snprintf(path, length, "%s/%s", overlaydir, list[index]->d_name);
+			set->files[set->count].path = path;
+			set->count++;
+		}
+		else
+		{
+			ret = -1;
+		}
+	}
+	for(index = 0; index < count; index++)
+	{
+		free(list[index]);
+	}
+	free(list);
+	return ret;
+}
+
+static void PolicySetClose(ModePolicySet *set)
+{
+	uint32_t index;
+	for(index = 0; index < set->count; index++)
+	{
+		free(set->files[index].path);
+		free(set->files[index].modes);
+		free(set->files[index].resources);
+	}
+	free(set->files);
+	(void)memset(set, 0, sizeof(ModePolicySet));
+}
+
+static int32_t OverlayFilter(const struct dirent *entry)
+{
+	size_t length = strlen(entry->d_name);
+	return ((entry->d_name[0] != '.') && (length > 4U) && (strcmp(&entry->d_name[length - 4U], ".xml") == 0)) ? 1 : 0;
+}
+
+/* up to MODE_PARSE_THREADS files at a time, this thread takes its share */
+static int32_t PolicySetParse(ModePolicySet *set)
+{
+	int32_t ret = 0;
+	pthread_t threads[MODE_PARSE_THREADS - 1];
+	uint32_t threadCount = 0;
+	uint32_t workers = (set->count < MODE_PARSE_THREADS) ? set->count : MODE_PARSE_THREADS;
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t index;
+
+	if((online > 0) && ((uint32_t)online < workers))
+	{
+		workers = (uint32_t)online;
+	}
+	/* libxml2 sets up its globals once, before any reader runs on another thread */
+	xmlInitParser();
+	set->next = 0;
+	while((threadCount + 1U) < workers)
+	{
+		if(pthread_create(&threads[threadCount], NULL, PolicySetWorker, set) != 0)
+		{
+			break;
+		}
+		threadCount++;
+	}
+	(void)PolicySetWorker(set);
+	for(index = 0; index < threadCount; index++)
+	{
+		(void)pthread_join(threads[index], NULL);
+	}
+	for(index = 0; index < set->count; index++)
+	{
+		const ModePolicyFile *file = &set->files[index];
+		if((file->ret == 0) && (file->failed != 0))
+		{
+			TCLog(TCLogLevelError, "%s : out of memory for %s\n", __FUNCTION__, file->path);
+			ret = -1;
+		}
+		else if(file->ret != 0)
+		{
+			TCLog(TCLogLevelError, "%s : %s not parsed\n", __FUNCTION__, file->path);
+			ret = -1;
+		}
+		else
+		{
+			TCLog(TCLogLevelInfo, "%s : %s, %u modes %u resources parsed in %llu usec\n", __FUNCTION__,
+				  file->path, file->modeCount, file->resourceCount, (unsigned long long)file->usec);
+		}
+	}
+	TCLog(TCLogLevelDebug, "%s : %u files on %u threads\n", __FUNCTION__, set->count, threadCount + 1U);
+	return ret;
+}
+
+static void *PolicySetWorker(void *arg)
+{
+	ModePolicySet *set = (ModePolicySet *)arg;
+	uint32_t index;
+	while((index = __atomic_fetch_add(&set->next, 1U, __ATOMIC_RELAXED)) < set->count)
+	{
+		ModePolicyFile *file = &set->files[index];
+		ModeParseSink sink;
+		uint64_t start = ModeStatsNow();
+		sink.mode = CollectMode;
+		sink.resource = CollectResource;
+		sink.user = file;
+		file->ret = ParseFile(file->path, &sink);
+		file->usec = (ModeStatsNow() - start) / 1000U;
+	}
+	return NULL;
+}
+
+static void CollectMode(const Mode *configMode, void *user)
+{
+	ModePolicyFile *file = (ModePolicyFile *)user;
+	Mode *modes = (Mode *)ModeArrayGrow(file->modes, &file->modeSize, file->modeCount, sizeof(Mode));
+	if(modes != NULL)
+	{
+		file->modes = modes;
+		file->modes[file->modeCount] = *configMode;
+		file->modeCount++;
+	}
+	else
+	{
+		file->failed = 1;
+	}
+}
+
+static void CollectResource(const char *name, int32_t mask, int32_t timeout, void *user)
+{
+	ModePolicyFile *file = (ModePolicyFile *)user;
+	ModeParsedResource *resources = (ModeParsedResource *)ModeArrayGrow(file->resources, &file->resourceSize,
+																		 file->resourceCount, sizeof(ModeParsedResource));
+	if(strlen(name) >= MODE_RESOURCE_NAME_MAX)
+	{
+		TCLog(TCLogLevelWarn, "%s : resource name %s too long in %s\n", __FUNCTION__, name, file->path);
+	}
+	else if(resources != NULL)
+	{
+		file->resources = resources;
+		(void)strcpy(file->resources[file->resourceCount].name, name);
+		file->resources[file->resourceCount].mask = mask;
+		file->resources[file->resourceCount].timeout = timeout;
+		file->resourceCount++;
+	}
+	else
+	{
+		file->failed = 1;
+	}
+}
+
+/*
+ * Keeps the last row of each (name, app) through an open addressing hash of row + 1,
+ * an overridden mode keeps the place of the row it replaces. Within one file the first
+ * row wins, as setModePolicy() has it.
+ */
+static int32_t PolicySetMerge(const ModePolicySet *set)
+{
+	int32_t ret = 0;
+	uint64_t start = ModeStatsNow();
+	uint32_t modeTotal = 0;
+	uint32_t resourceTotal = 0;
+	uint32_t hashSize = 64;
+	uint32_t *hash;
+	const Mode **rows;
+	uint32_t *origin;
+	const ModeParsedResource **resources;
+	uint32_t rowCount = 0;
+	uint32_t resourceCount = 0;
+	uint32_t overridden = 0;
+	uint32_t index;
+	uint32_t row;
+
+	for(index = 0; index < set->count; index++)
+	{
+		modeTotal += set->files[index].modeCount;
+		resourceTotal += set->files[index].resourceCount;
+	}
+	while(hashSize < (modeTotal * 2U))
+	{
+		hashSize *= 2U;
+	}
+	hash = (uint32_t *)calloc(hashSize, sizeof(uint32_t));
+	rows = (const Mode **)calloc((size_t)modeTotal + 1U, sizeof(const Mode *));
+	origin = (uint32_t *)calloc((size_t)modeTotal + 1U, sizeof(uint32_t));
+	resources = (const ModeParsedResource **)calloc((size_t)resourceTotal + 1U, sizeof(const ModeParsedResource *));
+	if((hash == NULL) || (rows == NULL) || (origin == NULL) || (resources == NULL))
+	{
+		TCLog(TCLogLevelError, "%s : out of memory\n", __FUNCTION__);
+		ret = -1;
+	}
+	for(index = 0; (ret == 0) && (index < set->count); index++)
+	{
+		const ModePolicyFile *file = &set->files[index];
+		for(row = 0; row < file->modeCount; row++)
+		{
+			const Mode *configMode = &file->modes[row];
+			uint32_t slot = PolicyKeyHash(configMode->mode, configMode->app) & (hashSize - 1U);
+			while((hash[slot] != 0U) &&
+				  ((rows[hash[slot] - 1U]->app != configMode->app) || (strcmp(rows[hash[slot] - 1U]->mode, configMode->mode) != 0)))
+			{
+				slot = (slot + 1U) & (hashSize - 1U);
+			}
+			if(hash[slot] == 0U)
+			{
+				rows[rowCount] = configMode;
+				origin[rowCount] = index;
+				rowCount++;
+				hash[slot] = rowCount;
+			}
+			else if(origin[hash[slot] - 1U] != index)
+			{
+				TCLog(TCLogLevelDebug, "%s : mode %s app %d from %s\n", __FUNCTION__, configMode->mode, configMode->app, file->path);
+				rows[hash[slot] - 1U] = configMode;
+				origin[hash[slot] - 1U] = index;
+				overridden++;
+			}
+			else
+			{
+				TCLog(TCLogLevelWarn, "%s : duplicated mode %s app %d in %s ignored\n", __FUNCTION__,
+					  configMode->mode, configMode->app, file->path);
+			}
+		}
+		for(row = 0; row < file->resourceCount; row++)
+		{
+			uint32_t found = 0;
+			while((found < resourceCount) && (strcmp(resources[found]->name, file->resources[row].name) != 0))
+			{
+				found++;
+			}
+			resources[found] = &file->resources[row];
+			if(found == resourceCount)
+			{
+				resourceCount++;
+			}
+		}
+	}
+	if(ret == 0)
+	{
+		uint64_t merged = ModeStatsNow();
+		for(row = 0; row < resourceCount; row++)
+		{
+			ParsedResource(resources[row]->name, resources[row]->mask, resources[row]->timeout, NULL);
+		}
+		for(row = 0; row < rowCount; row++)
+		{
+			ParsedMode(rows[row], NULL);
+		}
+		TCLog(TCLogLevelInfo, "%s : %u files merged to %u modes, %u overridden, in %llu usec, applied in %llu usec\n",
+			  __FUNCTION__, set->count, rowCount, overridden, (unsigned long long)((merged - start) / 1000U),
+			  (unsigned long long)((ModeStatsNow() - merged) / 1000U));
+	}
+	free(hash);
+	free(rows);
+	free(origin);
+	free(resources);
+	return ret;
+}
+
+static uint32_t PolicyKeyHash(const char *name, int32_t app)
+{
+	uint32_t hash = 2166136261U;
+	const uint8_t *byte = (const uint8_t *)name;
+	while(*byte != 0U)
+	{
+		hash ^= *byte;
+		hash *= 16777619U;
+		byte++;
+	}
+	hash ^= (uint32_t)app;
+	hash *= 16777619U;
+	return hash;
+}
@@ -30,16 +30,30 @@ between Telechips and Company.
 #include <stdint.h>
 #include <unistd.h>
 #include <glib.h>
+#include <glib-unix.h>
+#include <libgen.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <systemd/sd-daemon.h>
 
 #include "TCLog.h"
 #include "ModeXMLParser.h"
 #include "ModeDBusManager.h"
 #include "ModeManager.h"
+#include "ModeStats.h"
+#include "ModeTrace.h"
+#include "ModePolicyCache.h"
+#include "ModeStatePage.h"
 
 static GMainLoop *s_mainLoop = NULL;
+static const char *s_policyPath = "/usr/share/mode/defaultmode.xml";
+static const char *s_policyDir = MODE_POLICY_DIR;
+static int32_t s_policyCache = 1;
+static char s_policyName[NAME_MAX + 1];
+static int32_t s_policyWatch = -1;
+static int32_t s_overlayWatch = -1;
 
 const char *pid_file = "/var/run/TCModeManager.pid";
 
@@ -52,6 +66,116 @@ static void SignalHandler(int32_t sig)
 	}
 }
 
+static gboolean ModeTimerExpired(gpointer user_data)
+{
+	(void)user_data;
+	processModeManagerTimer();
+	return FALSE;
+}
+
+static void ModeTimerArm(int32_t msec)
+{
+	(void)g_timeout_add((guint)msec, ModeTimerExpired, NULL);
+}
+
+static gboolean StatsSignalHandler(gpointer user_data)
+{
+	(void)user_data;
+	ModeStatsDump();
+	return TRUE;
+}
+
+static gboolean TraceSignalHandler(gpointer user_data)
+{
+	(void)user_data;
+	(void)ModeTraceDump(MODE_TRACE_FILE);
+	return TRUE;
+}
+
+static int32_t LoadPolicy(void)
+{
+	return parseDocSet(s_policyPath, s_policyDir, (s_policyCache == 1) ? MODE_POLICY_CACHE_FILE : NULL);
+}
+
+static gboolean ReloadSignalHandler(gpointer user_data)
+{
+	(void)user_data;
+	(void)reloadModePolicy();
+	return TRUE;
+}
+
+static gboolean PolicyWatchHandler(gint fd, GIOCondition condition, gpointer user_data)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+	int32_t reload = 0;
+	(void)condition;
+	(void)user_data;
+	while((length = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		ssize_t offset = 0;
+		while(offset < length)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)&buffer[offset];
+			size_t nameLength = (event->len > 0U) ? strlen(event->name) : 0U;
+			if((event->wd == s_policyWatch) && (nameLength > 0U) && (strcmp(event->name, s_policyName) == 0))
+			{
+				reload = 1;
+			}
+			else if((event->wd == s_overlayWatch) && (nameLength > 4U) &&
+					(strcmp(&event->name[nameLength - 4U], ".xml") == 0))
+			{
+				reload = 1;
+			}
+			else
+			{
+				/* not a policy file */
+			}
+			offset += (ssize_t)sizeof(struct inotify_event) + (ssize_t)event->len;
+		}
+	}
+	if(reload == 1)
+	{
+		TCLog(TCLogLevelInfo, "%s : policy changed\n", __FUNCTION__);
+		(void)reloadModePolicy();
+	}
+	return TRUE;
+}
+
+/*
+ * The directories are watched, a file is often replaced by a rename. An overlay that goes
+ * away reloads too, the overlay directory itself has to exist when the watch starts.
+ */
+static void WatchPolicy(void)
+{
+	char path[PATH_MAX];
+	int32_t fd;
+	(void)snprintf(path, sizeof(path), "%s", s_policyPath);
+	(void)snprintf(s_policyName, sizeof(s_policyName), "%s", basename(path));
+	(void)snprintf(path, sizeof(path), "%s", s_policyPath);
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd >= 0)
+	{
+		s_policyWatch = inotify_add_watch(fd, dirname(path), IN_CLOSE_WRITE | IN_MOVED_TO);
+	}
+	if((fd >= 0) && (s_policyDir != NULL))
+	{
+		s_overlayWatch = inotify_add_watch(fd, s_policyDir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+	}
+	if((fd >= 0) && (s_policyWatch >= 0))
+	{
+		(void)g_unix_fd_add(fd, G_IO_IN, PolicyWatchHandler, NULL);
+	}
+	else
+	{
+		TCLog(TCLogLevelWarn, "%s : can not watch %s\n", __FUNCTION__, s_policyPath);
+		if(fd >= 0)
+		{
+			(void)close(fd);
+		}
+	}
+}
+
 static void Daemonize(void)
 {
 	pid_t pid;
@@ -110,6 +234,16 @@ static void usage(void)
 	TCLog(TCLogLevelInfo, "\t--debug : debug log on \n");
 	TCLog(TCLogLevelInfo, "\t--no-daemon : Don't fork(default fork)\n");
 	TCLog(TCLogLevelInfo, "\t--config-file=FILE : external mode config file(FILE: full file path)\n");
+	TCLog(TCLogLevelInfo, "\t--policy-dir=DIR : overlay *.xml files laid over the config file in name order(default %s)\n", MODE_POLICY_DIR);
+	TCLog(TCLogLevelInfo, "\t--inline-arbitration : arbitrate on the DBus thread instead of the manager thread\n");
+	TCLog(TCLogLevelInfo, "\t--decision-cache : answer a stack state seen before from the change_mode decision cache\n");
+	TCLog(TCLogLevelInfo, "\t--verify-decision-cache : check every cached change_mode decision against the stacks\n");
+	TCLog(TCLogLevelInfo, "\t--no-policy-cache : always parse the XML, don't use or write %s\n", MODE_POLICY_CACHE_FILE);
+	TCLog(TCLogLevelInfo, "\t--watch-policy : reload the policy when its file changes (SIGHUP always reloads)\n");
+	TCLog(TCLogLevelInfo, "\t--no-state-page : don't publish the resource owners in %s\n", MODE_STATE_PAGE_FILE);
+	TCLog(TCLogLevelInfo, "\t--coalesce : drop a queued change_mode a newer one of the same app covers, its caller gets %d\n", MODE_CHANGE_SUPERSEDED);
+	TCLog(TCLogLevelInfo, "\t--signal-batch : send the signals of one request back to back once it ran, superseded ones dropped\n");
+	TCLog(TCLogLevelInfo, "\t--transition-signal : send the signals of one request as a single transition signal\n");
 }
 
 int32_t main(int32_t argc, char *argv[])
@@ -117,7 +251,13 @@ int32_t main(int32_t argc, char *argv[])
 	int32_t ret = 0;
 	int32_t index;
 	char *configPath = NULL;
+	int32_t policyWatch = 0;
 	int32_t s_daemonize = 1;
+	int32_t inlineArbitration = 0;
+	int32_t decisionCache = MODE_DECISION_OFF;
+	int32_t statePage = 1;
+	int32_t signalBatch = MODE_SIGNAL_DIRECT;
+	int32_t coalesce = 0;
 
 	TCLogInitialize("MODEMAN", NULL, 0);
 
@@ -137,6 +277,46 @@ int32_t main(int32_t argc, char *argv[])
 			{
 				configPath = argv[index+1];
 			}
+			else if (strncmp(argv[index], "--policy-dir", 12) == 0)
+			{
+				s_policyDir = argv[index+1];
+			}
+			else if (strncmp(argv[index], "--inline-arbitration", 20) == 0)
+			{
+				inlineArbitration = 1;
+			}
+			else if (strncmp(argv[index], "--decision-cache", 16) == 0)
+			{
+				decisionCache = MODE_DECISION_CACHE;
+			}
+			else if (strncmp(argv[index], "--verify-decision-cache", 23) == 0)
+			{
+				decisionCache = MODE_DECISION_VERIFY;
+			}
+			else if (strncmp(argv[index], "--no-policy-cache", 17) == 0)
+			{
+				s_policyCache = 0;
+			}
+			else if (strncmp(argv[index], "--watch-policy", 14) == 0)
+			{
+				policyWatch = 1;
+			}
+			else if (strncmp(argv[index], "--no-state-page", 15) == 0)
+			{
+				statePage = 0;
+			}
+			else if (strncmp(argv[index], "--coalesce", 10) == 0)
+			{
+				coalesce = 1;
+			}
+			else if (strncmp(argv[index], "--signal-batch", 14) == 0)
+			{
+				signalBatch = MODE_SIGNAL_BATCH;
+			}
+			else if (strncmp(argv[index], "--transition-signal", 19) == 0)
+			{
+				signalBatch = MODE_SIGNAL_TRANSITION;
+			}
 			else if (strncmp(argv[index], "--help", 6) == 0)
 			{
 				usage();
@@ -163,25 +343,40 @@ int32_t main(int32_t argc, char *argv[])
 
 		if (s_mainLoop != NULL)
 		{
+			(void)g_unix_signal_add(SIGUSR1, StatsSignalHandler, NULL);
+			(void)g_unix_signal_add(SIGUSR2, TraceSignalHandler, NULL);
+			(void)g_unix_signal_add(SIGHUP, ReloadSignalHandler, NULL);
 			if(configPath != NULL)
 			{
-				ret = parseDoc((const char*)configPath);
-			}
-			else
-			{
-				ret = parseDoc("/usr/share/mode/defaultmode.xml");
+				s_policyPath = (const char*)configPath;
 			}
+			ret = LoadPolicy();
 			if(ret == 0)
 			{
-				ModeDBusInitialize();
-				(void)ModeManagerInitiallize();
 				ModeManagerSignalCB cb;
 				cb._ChangedMode = SendDBusChangedMode;
 				cb._ReleaseResource = SendDBusReleaseResource;
 				cb._EndedMode = SendDBusEndedMode;
 				cb._SuspendMode = SendDBusSuspendMode;
 				cb._ResumeMode = SendDBusResumeMode;
+				cb._Transition = SendDBusTransition;
 				setModeManagerSignalCB(&cb);
+				setModeManagerTimerCB(ModeTimerArm);
+				setModePolicyLoadCB(LoadPolicy);
+				setModeManagerInlineArbitration(inlineArbitration);
+				setModeManagerDecisionCache(decisionCache);
+				setModeManagerSignalBatch(signalBatch);
+				setModeManagerCoalesce(coalesce);
+				if(statePage == 1)
+				{
+					(void)ModeStatePageOpen(MODE_STATE_PAGE_FILE);
+				}
+				(void)ModeManagerInitiallize();
+				ModeDBusInitialize();
+				if(policyWatch == 1)
+				{
+					WatchPolicy();
+				}
 
 				(void)sd_notify(0, "READY=1");
 				g_main_loop_run(s_mainLoop);
@@ -189,6 +384,7 @@ int32_t main(int32_t argc, char *argv[])
 				s_mainLoop = NULL;
 
 				ModeManagerRelease();
+				ModeStatePageClose();
 				ModeDBusRelease();
 			}
 		}
@@ -0,0 +1,297 @@
+
+/****************************************************************************************
+ *   FileName    : ModeTraceDecode.c
+ *   Description : Mode Trace Decoder C File
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved
+
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code
+shall constitute any express or implied warranty of any kind, including without limitation,
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent,
+copyright or other third party intellectual property right.
+No warranty is made, express or implied, regarding the information’s accuracy,
+completeness, or performance.
+In no event shall Telechips be liable for any claim, damages or other liability arising from,
+out of or in connection with this source code or the use in the source code.
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ModeTrace.h"
+
+#define DECODE_APPS			65536
+
+static const char *s_eventNames[TotalModeTraceEvent] = {
+	"queued",
+	"change",
+	"end_mode",
+	"release_done",
+	"release_timeout",
+	"shutdown",
+	"suspend",
+	"resume",
+	"changed_mode",
+	"release_resource",
+	"ended_mode",
+	"reload"
+};
+
+static const char *s_requestNames[] = {
+	"change_mode",
+	"end_mode",
+	"release_resource_done",
+	"suspend",
+	"resume",
+	"timer",
+	"shutdown",
+	"reload_policy",
+	"change_modes"
+};
+
+static char **s_names = NULL;
+static uint32_t s_nameCount = 0;
+
+static const char *DecodeModeName(int32_t mode);
+static const char *DecodeArgument(const ModeTraceRecord *record, char *buffer, size_t size);
+static void usage(void);
+
+int32_t main(int32_t argc, char *argv[])
+{
+	int32_t ret = 0;
+	FILE *fp = NULL;
+	ModeTraceHeader header;
+	ModeTraceRecord *records = NULL;
+	uint64_t *queued = NULL;
+
+	if(argc != 2)
+	{
+		usage();
+		ret = -1;
+	}
+	if(ret == 0)
+	{
+		fp = fopen(argv[1], "rb");
+		if(fp == NULL)
+		{
+			(void)fprintf(stderr, "can not open %s\n", argv[1]);
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		if((fread(&header, sizeof(header), 1, fp) != 1U) ||
+		   (memcmp(header.magic, MODE_TRACE_MAGIC, sizeof(MODE_TRACE_MAGIC)) != 0) ||
+		   (header.version != MODE_TRACE_VERSION) ||
+		   (header.recordSize != (uint32_t)sizeof(ModeTraceRecord)))
+		{
+			(void)fprintf(stderr, "%s is not a version %d mode trace\n", argv[1], MODE_TRACE_VERSION);
+			ret = -1;
+		}
+	}
+	if(ret == 0)
+	{
+		uint32_t index;
+		s_names = (char **)calloc((header.nameCount > 0U) ? header.nameCount : 1U, sizeof(char *));
+		records = (ModeTraceRecord *)calloc((header.recordCount > 0U) ? header.recordCount : 1U, sizeof(ModeTraceRecord));
+		queued = (uint64_t *)calloc(DECODE_APPS, sizeof(uint64_t));
+		if((s_names == NULL) || (records == NULL) || (queued == NULL))
+		{
+			(void)fprintf(stderr, "out of memory\n");
+			ret = -1;
+		}
+		for(index = 0; (index < header.nameCount) && (ret == 0); index++)
+		{
+			uint16_t length;
+			if(fread(&length, sizeof(length), 1, fp) == 1U)
+			{
+				s_names[index] = (char *)calloc((size_t)length + 1U, 1);
+				if((s_names[index] == NULL) || (fread(s_names[index], 1, length, fp) != length))
+				{
+					ret = -1;
+				}
+				s_nameCount = index + 1U;
+			}
+			else
+			{
+				ret = -1;
+			}
+		}
+		if((ret == 0) && (fread(records, sizeof(ModeTraceRecord), header.recordCount, fp) != header.recordCount))
+		{
+			ret = -1;
+		}
+		if(ret != 0)
+		{
+			(void)fprintf(stderr, "%s is truncated\n", argv[1]);
+		}
+	}
+	if((ret == 0) && (header.recordCount > 0U))
+	{
+		uint64_t origin = records[0].time;
+		uint64_t wallclock = header.realTime - (header.monotonicTime - origin);
+		int32_t openMode = -1;
+		int32_t openApp = 0;
+		uint64_t openStart = 0;
+		uint64_t openCommit = 0;
+		bool open = false;
+		uint32_t transitions = 0;
+		uint32_t superseded = 0;
+		uint64_t latencyMin = UINT64_MAX;
+		uint64_t latencyMax = 0;
+		uint64_t latencySum = 0;
+		uint32_t index;
+		char argument[64];
+
+		(void)printf("%u events, first at %llu.%06llu (realtime)\n", header.recordCount,
+					 (unsigned long long)(wallclock / 1000000000U), (unsigned long long)((wallclock % 1000000000U) / 1000U));
+		(void)printf("%12s %-16s %5s %-20s %-24s %9s %9s %9s %9s\n",
+					 "msec", "event", "app", "mode", "arg", "audio", "display", "tuner", "release");
+		for(index = 0; index < header.recordCount; index++)
+		{
+			const ModeTraceRecord *record = &records[index];
+			uint64_t latency = 0;
+			bool done = false;
+
+			(void)printf("%12.3f %-16s %5d %-20s %-24s %5u(%+d) %5u(%+d) %5u(%+d) %5u(%+d)\n",
+						 (double)(int64_t)(record->time - origin) / 1000000.0,
+						 (record->event < (uint16_t)TotalModeTraceEvent) ? s_eventNames[record->event] : "?",
+						 record->app, DecodeModeName(record->mode), DecodeArgument(record, argument, sizeof(argument)),
+						 record->audio, record->audioDelta, record->display, record->displayDelta,
+						 record->tuner, record->tunerDelta, record->release, record->releaseDelta);
+
+			/* a transition runs from change_mode being queued to changed_mode reaching its app */
+			if((record->event == (uint16_t)ModeTraceQueued) && (record->arg == 0))
+			{
+				queued[(uint16_t)record->app] = record->time;
+			}
+			else if((record->event == (uint16_t)ModeTraceChange) && (record->arg != 0))
+			{
+				if(open)
+				{
+					(void)printf("             -> transition to %s/%d superseded\n", DecodeModeName(openMode), openApp);
+					superseded++;
+				}
+				openMode = record->mode;
+				openApp = record->app;
+				openStart = (queued[(uint16_t)record->app] != 0U) ? queued[(uint16_t)record->app] : record->time;
+				openCommit = record->time;
+				open = true;
+				if(record->release == 0U)
+				{
+					/* nobody had to release, changed_mode went out while it ran */
+					latency = record->time - openStart;
+					done = true;
+				}
+			}
+			else if(open && (record->event == (uint16_t)ModeTraceChangedMode) &&
+					(record->app == openApp) && (record->mode == openMode))
+			{
+				latency = record->time - openStart;
+				done = true;
+			}
+			else
+			{
+			}
+
+			if(done)
+			{
+				(void)printf("             -> transition to %s/%d : %.3f msec (release handshake %.3f msec)\n",
+							 DecodeModeName(openMode), openApp, (double)latency / 1000000.0,
+							 (record->time > openCommit) ? ((double)(record->time - openCommit) / 1000000.0) : 0.0);
+				transitions++;
+				latencySum += latency;
+				latencyMin = (latency < latencyMin) ? latency : latencyMin;
+				latencyMax = (latency > latencyMax) ? latency : latencyMax;
+				open = false;
+			}
+		}
+
+		if(transitions > 0U)
+		{
+			(void)printf("%u transitions : min %.3f avg %.3f max %.3f msec, %u superseded, %u still open\n",
+						 transitions, (double)latencyMin / 1000000.0,
+						 ((double)latencySum / (double)transitions) / 1000000.0, (double)latencyMax / 1000000.0,
+						 superseded, open ? 1U : 0U);
+		}
+	}
+
+	if(fp != NULL)
+	{
+		(void)fclose(fp);
+	}
+	free(records);
+	free(queued);
+	if(s_names != NULL)
+	{
+		uint32_t index;
+		for(index = 0; index < s_nameCount; index++)
+		{
+			free(s_names[index]);
+		}
+		free(s_names);
+	}
+	return ret;
+}
+
+static const char *DecodeModeName(int32_t mode)
+{
+	const char *ret = "-";
+	if((mode >= 0) && ((uint32_t)mode < s_nameCount) && (s_names[mode] != NULL))
+	{
+		ret = s_names[mode];
+	}
+	return ret;
+}
+
+static const char *DecodeArgument(const ModeTraceRecord *record, char *buffer, size_t size)
+{
+	buffer[0] = '\0';
+	if(record->event == (uint16_t)ModeTraceQueued)
+	{
+		if((record->arg >= 0) && ((size_t)record->arg < (sizeof(s_requestNames) / sizeof(s_requestNames[0]))))
+		{
+			(void)snprintf(buffer, size, "%s", s_requestNames[record->arg]);
+		}
+		else
+		{
+			(void)snprintf(buffer, size, "request %d", record->arg);
+		}
+	}
+	else if(record->event == (uint16_t)ModeTraceChange)
+	{
+		(void)snprintf(buffer, size, "result %d", record->arg);
+	}
+	else if((record->event == (uint16_t)ModeTraceReleaseDone) ||
+			(record->event == (uint16_t)ModeTraceReleaseTimeout) ||
+			(record->event == (uint16_t)ModeTraceReleaseResource))
+	{
+		(void)snprintf(buffer, size, "resources 0x%x", (uint32_t)record->arg);
+	}
+	else if(record->event == (uint16_t)ModeTraceReload)
+	{
+		(void)snprintf(buffer, size, "%d modes", record->arg);
+	}
+	else
+	{
+	}
+	return buffer;
+}
+
+static void usage(void)
+{
+	(void)printf("Usage : TCModeTraceDecode FILE\n");
+	(void)printf("\tdecodes a TCModeManager flight recorder dump (SIGUSR2 or dump_trace) into a timeline\n");
+}